@@ -0,0 +1,102 @@
+#include "Benchmark.h"
+#include "DebugOutput.h"
+
+// Replies captured from a Tasmota 13 smart plug
+static const char POWER_REPLY[] = "{\"POWER\":\"ON\"}";
+static const char STATUS_10_REPLY[] =
+    "{\"StatusSNS\":{\"Time\":\"2024-04-20T12:00:00\",\"ENERGY\":{\"TotalStartTime\":\"2023-11-05T10:21:44\","
+    "\"Total\":12.345,\"Yesterday\":0.512,\"Today\":0.231,\"Power\":57,\"ApparentPower\":63,\"ReactivePower\":27,"
+    "\"Factor\":0.90,\"Voltage\":231,\"Current\":0.272}}}";
+static const char STATUS_11_REPLY[] =
+    "{\"StatusSTS\":{\"Time\":\"2024-04-20T12:00:00\",\"Uptime\":\"0T02:13:45\",\"UptimeSec\":8025,\"Heap\":25,"
+    "\"SleepMode\":\"Dynamic\",\"Sleep\":50,\"LoadAvg\":19,\"MqttCount\":0,\"POWER\":\"ON\",\"Wifi\":{\"AP\":1,"
+    "\"SSId\":\"plugAP3341\",\"BSSId\":\"34:85:18:6A:33:41\",\"Channel\":1,\"Mode\":\"11n\",\"RSSI\":78,"
+    "\"Signal\":-61,\"LinkCount\":1,\"Downtime\":\"0T00:00:03\"}}}";
+
+// Discards output so logging can be timed without the cost of the serial port
+class NullStream : public Stream {
+public:
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t*, size_t size) override { return size; }
+};
+
+// The parsers deserialize in place, so each iteration starts from a fresh copy of the reply
+static char scratch[sizeof(STATUS_11_REPLY)];
+static volatile int sink;   // keeps results live so the compiler cannot drop the work
+
+static void benchCopyOnly(void* context) {
+    strcpy(scratch, static_cast<const char*>(context));
+}
+
+static void benchParsePower(void* context) {
+    strcpy(scratch, POWER_REPLY);
+    sink = TasmotaPlugs::parsePowerState(scratch);
+}
+
+static void benchParseStatus10(void* context) {
+    EnergyValues values;
+    strcpy(scratch, STATUS_10_REPLY);
+    sink = TasmotaPlugs::parseEnergyValues(scratch, values);
+}
+
+static void benchParseRSSI(void* context) {
+    strcpy(scratch, STATUS_11_REPLY);
+    sink = TasmotaPlugs::parseRSSI(scratch);
+}
+
+static void benchParseStatus11(void* context) {
+    StateStatus status;
+    strcpy(scratch, STATUS_11_REPLY);
+    sink = TasmotaPlugs::parseStateStatus(scratch, status);
+}
+
+static void benchIPAddress(void* context) {
+    TasmotaPlugs* plugs = static_cast<TasmotaPlugs*>(context);
+    sink = plugs->getIPAddress(plugs->plugs[0][0])[0];
+}
+
+static void benchErrorString(void* context) {
+    sink = TasmotaPlugs::getErrorString(TasmotaPlugs::ERR_PLUG_REF_INVALID)[0];
+}
+
+static void benchLogging(void* context) {
+    DebugOutput* logger = static_cast<DebugOutput*>(context);
+    logger->debug("plug  at %s has state %d, pin %d has state %d\n", "http://192.168.4.13", 1, 6, 0);
+}
+
+Benchmark::Benchmark(Stream& outputStream, uint32_t iterations, ClockNs clock)
+    : output(&outputStream), iterations(iterations), clock(clock) {}
+
+void Benchmark::run(const char* name, BenchFunction function, void* context) {
+    function(context);  // warm up caches before timing
+    uint32_t heapBefore = ESP.getFreeHeap();
+    uint64_t startNs = clock();
+    for (uint32_t i = 0; i < iterations; i++) {
+        function(context);
+    }
+    uint64_t elapsedNs = clock() - startNs;
+    long heapDelta = (long)ESP.getFreeHeap() - (long)heapBefore;
+    output->printf("bench|{\"name\":\"%s\",\"iterations\":%lu,\"real_time\":%.1f,\"time_unit\":\"ns\",\"heap_delta\":%ld}\n",
+                   name, (unsigned long)iterations, (double)elapsedNs / iterations, heapDelta);
+    yield();
+}
+
+void Benchmark::runPlugBenchmarks(TasmotaPlugs& plugs) {
+    run("copy_status_11_reply", benchCopyOnly, (void*)STATUS_11_REPLY);  // baseline included in the parse times
+    run("parse_power", benchParsePower, nullptr);
+    run("parse_status_10_energy", benchParseStatus10, nullptr);
+    run("parse_status_11_rssi", benchParseRSSI, nullptr);
+    run("parse_status_11_state", benchParseStatus11, nullptr);
+    if (!plugs.plugs.empty() && !plugs.plugs[0].empty()) {
+        run("plug_ip_address", benchIPAddress, &plugs);
+    }
+    run("error_string", benchErrorString, nullptr);
+
+    NullStream nullStream;
+    DebugOutput logger;
+    logger.begin(2, nullStream);
+    run("debug_output_format", benchLogging, &logger);
+}
@@ -0,0 +1,36 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+#include "TasmotaPlugs.h"
+
+/*
+   Times the gateway's hot paths using replies recorded from real plugs, on the device with
+   the Bench serial command and on the PC with the native_bench environment. Each result is
+   printed as one line, "bench|" followed by a JSON object with the benchmark name, iteration
+   count, mean time per iteration and change in free heap.
+*/
+class Benchmark {
+public:
+    typedef void (*BenchFunction)(void* context);
+    typedef uint64_t (*ClockNs)();   // monotonic time in nanoseconds
+
+    static constexpr uint32_t DEFAULT_ITERATIONS = 1000;
+
+    // The default clock is micros(), the native build passes a wall clock as its micros() is simulated
+    Benchmark(Stream& outputStream = Serial, uint32_t iterations = DEFAULT_ITERATIONS, ClockNs clock = microsClock);
+    void run(const char* name, BenchFunction function, void* context);
+
+    // JSON extraction from Power, Status 10 and Status 11 replies, plug addresses, error strings
+    // and log formatting. plugs needs one configured plug for the address benchmark
+    void runPlugBenchmarks(TasmotaPlugs& plugs);
+
+private:
+    Stream* output;
+    uint32_t iterations;
+    ClockNs clock;
+
+    static uint64_t microsClock() { return (uint64_t)micros() * 1000; }
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,24 @@
+#include "BootTimer.h"
+
+BootTimer::BootTimer() : phaseCount(0) {}
+
+void BootTimer::mark(const char* phase) {
+    if (phaseCount < MAX_PHASES) {
+        phaseNames[phaseCount] = phase;
+        phaseEnds[phaseCount] = millis();
+        phaseCount++;
+    }
+}
+
+void BootTimer::report(DebugOutput& logger) {
+    unsigned long previous = 0;  // millis() counts from reset, so the first phase starts at zero
+    logger.info("Boot phases (ms):\n");
+    for (int i = 0; i < phaseCount; i++) {
+        logger.info("  %-16s %6lu  (at %lu)\n", phaseNames[i], phaseEnds[i] - previous, phaseEnds[i]);
+        previous = phaseEnds[i];
+    }
+}
+
+unsigned long BootTimer::elapsed() const {
+    return phaseCount > 0 ? phaseEnds[phaseCount - 1] : 0;
+}
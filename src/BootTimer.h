@@ -0,0 +1,27 @@
+#ifndef BOOTTIMER_H
+#define BOOTTIMER_H
+
+#include <Arduino.h>
+#include "DebugOutput.h"
+
+// Records the time at which each startup phase completes so boot time can be reported
+class BootTimer {
+public:
+    BootTimer();
+
+    // Marks the end of the named phase, the name must be a string literal
+    void mark(const char* phase);
+
+    // Prints each phase duration and the time since reset at which it completed
+    void report(DebugOutput& logger);
+
+    unsigned long elapsed() const;
+
+private:
+    static constexpr int MAX_PHASES = 12;
+    const char* phaseNames[MAX_PHASES];
+    unsigned long phaseEnds[MAX_PHASES];   // millis() at the end of each phase
+    int phaseCount;
+};
+
+#endif // BOOTTIMER_H
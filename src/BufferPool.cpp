@@ -0,0 +1,66 @@
+#include "BufferPool.h"
+#include <new>
+
+BufferPool::BufferPool() : blocks(nullptr), inUse(nullptr), blockCount(0), lock(portMUX_INITIALIZER_UNLOCKED) {}
+
+bool BufferPool::begin(int count) {
+    if (blocks != nullptr) {
+        return true;
+    }
+    count = count > MIN_BLOCK_COUNT ? count : MIN_BLOCK_COUNT;
+    blocks = new (std::nothrow) char[count * BLOCK_SIZE];
+    inUse = new (std::nothrow) bool[count];
+    if (blocks == nullptr || inUse == nullptr) {
+        delete[] blocks;
+        delete[] inUse;
+        blocks = nullptr;
+        inUse = nullptr;
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        inUse[i] = false;
+    }
+    blockCount = count;
+    return true;
+}
+
+char* BufferPool::acquire(uint32_t waitMs) {
+    unsigned long startTime = millis();
+    while (true) {
+        portENTER_CRITICAL(&lock);
+        for (int i = 0; i < blockCount; i++) {
+            if (!inUse[i]) {
+                inUse[i] = true;
+                portEXIT_CRITICAL(&lock);
+                return blocks + i * BLOCK_SIZE;
+            }
+        }
+        portEXIT_CRITICAL(&lock);
+        if (millis() - startTime >= waitMs) {
+            return nullptr;
+        }
+        delay(5);
+    }
+}
+
+void BufferPool::release(char* block) {
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < blockCount; i++) {
+        if (blocks + i * BLOCK_SIZE == block) {
+            inUse[i] = false;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+int BufferPool::available() {
+    int count = 0;
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < blockCount; i++) {
+        if (!inUse[i]) {
+            count++;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return count;
+}
@@ -0,0 +1,32 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <Arduino.h>
+
+// Set of blocks for transient HTTP response data, allocated once by begin().
+// Blocks are never freed, so repeated requests do not fragment the heap.
+class BufferPool {
+public:
+    static constexpr size_t BLOCK_SIZE = 1024;  // largest expected response (Status 11) plus headers
+    static constexpr int MIN_BLOCK_COUNT = 4;   // concurrent requests from the loop, I2C and diagnostics
+
+    BufferPool();
+
+    // Allocates max(blockCount, MIN_BLOCK_COUNT) blocks, one per startup reconciliation task.
+    // Only the first call allocates, returns false if the blocks could not be allocated
+    bool begin(int blockCount);
+
+    // Returns a free block, waiting up to waitMs for one to be released. Returns nullptr if none is free
+    char* acquire(uint32_t waitMs = 0);
+    void release(char* block);
+    int available();
+    int size() const { return blockCount; }
+
+private:
+    char* blocks;       // blockCount blocks of BLOCK_SIZE bytes
+    bool* inUse;
+    int blockCount;
+    portMUX_TYPE lock;
+};
+
+#endif // BUFFERPOOL_H
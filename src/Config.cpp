@@ -14,10 +14,14 @@ bool Config::loadConfig() {
         Serial.println("Failed to open config file for reading");
         return false;
     }
+    bool parsed = parseConfig(configFile);
+    configFile.close();
+    return parsed;
+}
 
+bool Config::parseConfig(Stream& inputStream) {
     StaticJsonDocument<1024> doc;
-    DeserializationError error = deserializeJson(doc, configFile);
-    configFile.close();
+    DeserializationError error = deserializeJson(doc, inputStream);
 
     if (error) {
         Serial.println("Failed to parse config file: " + String(error.c_str()));
@@ -27,10 +31,12 @@ bool Config::loadConfig() {
     JsonArray esp_pin_map_json = doc["esp_pin_map"];
     JsonArray plug_ip_json = doc["plug_ip"];
     JsonArray plugs_per_ip_json = doc["plugs_per_ip"];
+    JsonArray plug_priority_json = doc["plug_priority"];
 
     esp_pin_map.clear();
     plug_ip.clear();
     plugs_per_ip.clear();
+    plug_priority.clear();
 
     for (int pin : esp_pin_map_json) {
         esp_pin_map.push_back(pin);
@@ -41,6 +47,14 @@ bool Config::loadConfig() {
     for (int count : plugs_per_ip_json) {
         plugs_per_ip.push_back(count);
     }
+    for (int priority : plug_priority_json) {
+        plug_priority.push_back(priority);
+    }
+    power_budget = doc["power_budget"] | 0;
+    power_hysteresis = doc["power_hysteresis"] | 0;
+    rssi_threshold = doc["rssi_threshold"] | 20;
+    first_plug_id = doc["first_plug_id"] | 0;
+    telemetry_rate = doc["telemetry_rate"] | 2.0f;
 
     return true;
 }
@@ -70,6 +84,17 @@ void Config::writeConfigToStream(const std::string& ssid, Stream &outputStream)
     for (int count : plugs_per_ip) {
         plugs_per_ip_json.add(count);
     }
+    if (power_budget > 0) {
+        JsonArray plug_priority_json = root.createNestedArray("plug_priority");
+        for (int priority : plug_priority) {
+            plug_priority_json.add(priority);
+        }
+        root["power_budget"] = power_budget;
+        root["power_hysteresis"] = power_hysteresis;
+    }
+    root["rssi_threshold"] = rssi_threshold;
+    root["first_plug_id"] = first_plug_id;
+    root["telemetry_rate"] = telemetry_rate;
 
     serializeJson(doc, outputStream);
     outputStream.println();
@@ -110,6 +135,17 @@ bool Config::saveConfig() {
     for (int count : plugs_per_ip) {
         plugs_per_ip_json.add(count);
     }
+    if (power_budget > 0) {
+        JsonArray plug_priority_json = root.createNestedArray("plug_priority");
+        for (int priority : plug_priority) {
+            plug_priority_json.add(priority);
+        }
+        root["power_budget"] = power_budget;
+        root["power_hysteresis"] = power_hysteresis;
+    }
+    root["rssi_threshold"] = rssi_threshold;
+    root["first_plug_id"] = first_plug_id;
+    root["telemetry_rate"] = telemetry_rate;
 
     if (serializeJson(doc, configFile) == 0) {
         Serial.println("Failed to write to config file");
@@ -137,5 +173,17 @@ void Config::printConfig() {
     for (int count : plugs_per_ip) {
         Serial.print(count); Serial.print(", "); 
     }
+
+    Serial.print("\nFirst plug id: "); Serial.print(first_plug_id);
+    Serial.print("\nTelemetry requests per second: "); Serial.print(telemetry_rate);
+
+    if (power_budget > 0) {
+        Serial.print("\nPower budget: "); Serial.print(power_budget);
+        Serial.print(" W, hysteresis: "); Serial.print(power_hysteresis);
+        Serial.print(" W\nPlug priority: ");
+        for (int priority : plug_priority) {
+            Serial.print(priority); Serial.print(", ");
+        }
+    }
     Serial.println("\n");
 }
@@ -10,6 +10,7 @@
 class Config {
 public:
     bool loadConfig();
+    bool parseConfig(Stream& inputStream);   // reads the keys of config.json, as loadConfig does
     void writeConfigToStream(const std::string& ssid, Stream &outputStream = Serial);
     bool readConfigFromStream(Stream& inputStream);
     bool saveConfig();
@@ -18,6 +19,12 @@ public:
     std::vector<int> esp_pin_map;
     std::vector<int> plug_ip;
     std::vector<int> plugs_per_ip;
+    std::vector<int> plug_priority;   // load shedding priority per IP, lowest is shed first
+    int power_budget = 0;             // total watts allowed across all plugs, 0 disables load shedding
+    int power_hysteresis = 0;         // watts below the budget required before a shed plug is restored
+    float telemetry_rate = 2;         // energy value requests per second shared by all plugs
+    int first_plug_id = 0;            // global id of the first plug when gateways share a fleet
+    int rssi_threshold = 20;          // signal quality (percent) below which a weak signal event is raised
 
 private:
     bool internalLoadConfig();
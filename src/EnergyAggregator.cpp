@@ -0,0 +1,108 @@
+#include "EnergyAggregator.h"
+#include "TasmotaPlugs.h"
+
+// window length divided by BUCKETS_PER_WINDOW
+const uint32_t EnergyAggregator::bucketMs[WINDOW_COUNT] = {
+    60000UL / BUCKETS_PER_WINDOW,
+    900000UL / BUCKETS_PER_WINDOW,
+    3600000UL / BUCKETS_PER_WINDOW
+};
+
+EnergyAggregator::EnergyAggregator() {}
+
+void EnergyAggregator::begin(size_t plugCount, DebugOutput& logger) {
+    log = logger;
+    series.clear();
+    series.resize(plugCount + 1);   // value initialized, so every bucket starts empty
+}
+
+void EnergyAggregator::addSample(int ipIndex, float power, float fleetPower, unsigned long timeMs) {
+    if (ipIndex < 0 || (size_t)ipIndex + 1 >= series.size()) {
+        return;
+    }
+    update(series[ipIndex], power, timeMs);
+    update(series.back(), fleetPower, timeMs);
+}
+
+void EnergyAggregator::update(Series& target, float power, unsigned long timeMs) {
+    // the power since the previous sample is taken as the average of the two readings
+    uint32_t elapsedMs = 0;
+    float intervalPower = power;
+    if (target.lastTimeMs != 0 && timeMs - target.lastTimeMs <= MAX_GAP_MS) {
+        elapsedMs = timeMs - target.lastTimeMs;
+        intervalPower = (target.lastPower + power) / 2;
+        target.energyWh += intervalPower * (double)elapsedMs / 3600000.0;
+    }
+    target.lastPower = power;
+    target.lastTimeMs = timeMs;
+
+    for (int window = 0; window < WINDOW_COUNT; window++) {
+        uint32_t epoch = timeMs / bucketMs[window] + 1;   // +1 so zero marks an unused bucket
+        Bucket& bucket = target.buckets[window][epoch % BUCKETS_PER_WINDOW];
+        if (bucket.epoch != epoch) {
+            bucket = Bucket{epoch, 0, 0, power, power, 0};
+        }
+        bucket.weightedSum += intervalPower * elapsedMs;   // same trapezoid as the energy, so mean and energy agree
+        bucket.weightMs += elapsedMs;
+        bucket.minPower = power < bucket.minPower ? power : bucket.minPower;
+        bucket.maxPower = power > bucket.maxPower ? power : bucket.maxPower;
+        bucket.count++;
+    }
+}
+
+int EnergyAggregator::getAggregate(int ipIndex, AggregateWindow window, AggregateValues& values) {
+    Series* target;
+    if (ipIndex == FLEET_INDEX && !series.empty()) {
+        target = &series.back();
+    } else if (ipIndex >= 0 && (size_t)ipIndex + 1 < series.size()) {
+        target = &series[ipIndex];
+    } else {
+        return TasmotaPlugs::ERR_PLUG_REF_INVALID;
+    }
+    if (window >= WINDOW_COUNT) {
+        return TasmotaPlugs::ERR_UNHANDLED_CASE;
+    }
+
+    uint32_t currentEpoch = millis() / bucketMs[window] + 1;
+    float weightedSum = 0;
+    uint32_t weightMs = 0;
+    uint32_t count = 0;
+    values.minPower = 0;
+    values.maxPower = 0;
+    for (int i = 0; i < BUCKETS_PER_WINDOW; i++) {
+        Bucket& bucket = target->buckets[window][i];
+        if (bucket.count == 0 || currentEpoch - bucket.epoch >= BUCKETS_PER_WINDOW) {
+            continue;   // empty, or left over from an earlier pass around the ring
+        }
+        if (count == 0 || bucket.minPower < values.minPower) {
+            values.minPower = bucket.minPower;
+        }
+        if (count == 0 || bucket.maxPower > values.maxPower) {
+            values.maxPower = bucket.maxPower;
+        }
+        weightedSum += bucket.weightedSum;
+        weightMs += bucket.weightMs;
+        count += bucket.count;
+    }
+    values.meanPower = weightMs > 0 ? weightedSum / weightMs : target->lastPower;
+    values.energyWh = (float)target->energyWh;
+    return count > 0 ? TasmotaPlugs::RET_SUCCESS : TasmotaPlugs::ERR_UNKNOWN_STATE;
+}
+
+void EnergyAggregator::printAggregates(Stream& outputStream) {
+    static const char* const windowNames[WINDOW_COUNT] = {"1m", "15m", "1h"};
+    for (size_t i = 0; i < series.size(); i++) {
+        int ipIndex = (i + 1 == series.size()) ? FLEET_INDEX : (int)i;
+        for (int window = 0; window < WINDOW_COUNT; window++) {
+            AggregateValues values;
+            int result = getAggregate(ipIndex, (AggregateWindow)window, values);
+            if (ipIndex == FLEET_INDEX) {
+                outputStream.print("agg|index=fleet");
+            } else {
+                outputStream.printf("agg|index=%d", ipIndex);
+            }
+            outputStream.printf(",window=%s,result=%d,min=%.1f,max=%.1f,mean=%.1f,energyWh=%.3f\n", windowNames[window],
+                                result, values.minPower, values.maxPower, values.meanPower, values.energyWh);
+        }
+    }
+}
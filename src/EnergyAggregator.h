@@ -0,0 +1,69 @@
+#ifndef ENERGYAGGREGATOR_H
+#define ENERGYAGGREGATOR_H
+
+#include <vector>
+#include <Arduino.h>
+#include "DebugOutput.h"
+
+// Rolling windows over which power statistics are kept
+enum AggregateWindow : uint8_t {
+    WINDOW_1_MIN,
+    WINDOW_15_MIN,
+    WINDOW_1_HOUR,
+    WINDOW_COUNT
+};
+
+// Sent as the I2C payload of the 'A' command
+struct AggregateValues {
+    float minPower;    // Watts
+    float maxPower;    // Watts
+    float meanPower;   // Watts, time weighted
+    float energyWh;    // Watt hours integrated from power samples since startup
+};
+
+/*
+   Integrates energy from power samples and keeps rolling min/max/mean power per plug and
+   for the whole fleet. Each window is a ring of buckets, so adding a sample updates one
+   bucket per window in constant time; reading a window combines its buckets.
+*/
+class EnergyAggregator {
+public:
+    static constexpr int BUCKETS_PER_WINDOW = 30;
+    static constexpr uint32_t MAX_GAP_MS = 120000;  // samples further apart than this are not integrated
+    static constexpr uint8_t FLEET_INDEX = 0xFF;     // index used to read fleet wide aggregates
+
+    EnergyAggregator();
+    void begin(size_t plugCount, DebugOutput& logger);
+
+    // Adds a power sample for one plug and the resulting fleet total
+    void addSample(int ipIndex, float power, float fleetPower, unsigned long timeMs);
+
+    // Returns RET_SUCCESS, or a negative error code if the index is invalid or the window has no data
+    int getAggregate(int ipIndex, AggregateWindow window, AggregateValues& values);
+    void printAggregates(Stream& outputStream = Serial);
+
+private:
+    struct Bucket {
+        uint32_t epoch;       // bucket number since startup, identifies stale ring entries
+        float weightedSum;    // power multiplied by milliseconds
+        uint32_t weightMs;
+        float minPower;
+        float maxPower;
+        uint16_t count;
+    };
+
+    struct Series {
+        Bucket buckets[WINDOW_COUNT][BUCKETS_PER_WINDOW];
+        double energyWh;    // a float stops resolving short intervals after a few days of kilowatt load
+        float lastPower;
+        unsigned long lastTimeMs;   // 0 until the first sample
+    };
+
+    std::vector<Series> series;   // one per plug followed by the fleet
+    DebugOutput log;
+
+    static const uint32_t bucketMs[WINDOW_COUNT];
+    void update(Series& target, float power, unsigned long timeMs);
+};
+
+#endif // ENERGYAGGREGATOR_H
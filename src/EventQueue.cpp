@@ -0,0 +1,37 @@
+#include "EventQueue.h"
+
+EventQueue::EventQueue() : head(0), count(0), dropped(0) {}
+
+void EventQueue::push(EventType type, int ipIndex, int subIndex, int value) {
+    if (count == CAPACITY) {
+        head = (head + 1) % CAPACITY;
+        count--;
+        dropped++;
+    }
+    GatewayEvent& event = events[(head + count) % CAPACITY];
+    event.timeMs = millis();
+    event.type = type;
+    event.ipIndex = ipIndex;
+    event.subIndex = subIndex;
+    event.value = constrain(value, -128, 127);
+    count++;
+}
+
+int EventQueue::pop(GatewayEvent* output, int maxEvents) {
+    int removed = 0;
+    while (removed < maxEvents && count > 0) {
+        output[removed++] = events[head];
+        head = (head + 1) % CAPACITY;
+        count--;
+    }
+    return removed;
+}
+
+void EventQueue::printEvents(Stream& outputStream) {
+    for (int i = 0; i < count; i++) {
+        GatewayEvent& event = events[(head + i) % CAPACITY];
+        outputStream.printf("event|time=%lu,type=%d,index=%d,subIndex=%d,value=%d\n", (unsigned long)event.timeMs,
+                            event.type, event.ipIndex, event.subIndex, event.value);
+    }
+    outputStream.printf("events|queued=%d,dropped=%lu\n", count, (unsigned long)dropped);
+}
@@ -0,0 +1,44 @@
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <Arduino.h>
+
+// Changes to a plug that were not caused by a gateway command
+enum EventType : uint8_t {
+    EVENT_RELAY_CHANGED = 1,    // value: new relay state
+    EVENT_PLUG_UNREACHABLE = 2,
+    EVENT_PLUG_REACHABLE = 3,   // value: relay state
+    EVENT_PLUG_RESTARTED = 4,   // value: relay state
+    EVENT_RSSI_LOW = 5,         // value: rssi
+    EVENT_RSSI_OK = 6,          // value: rssi
+};
+
+// 8 bytes, so four events fit in the 32 byte receive buffer of an AVR I2C master
+struct __attribute__((packed)) GatewayEvent {
+    uint32_t timeMs;    // millis() on the gateway when the change was detected
+    uint8_t type;       // EventType
+    uint8_t ipIndex;
+    uint8_t subIndex;
+    int8_t value;
+};
+
+// Bounded FIFO of events, the oldest event is discarded when the queue is full
+class EventQueue {
+public:
+    static constexpr int CAPACITY = 32;
+
+    EventQueue();
+    void push(EventType type, int ipIndex, int subIndex, int value);
+    int pop(GatewayEvent* events, int maxEvents);   // removes up to maxEvents, returns the number removed
+    int size() const { return count; }
+    uint32_t getDropped() const { return dropped; }
+    void printEvents(Stream& outputStream = Serial);  // lists queued events without removing them
+
+private:
+    GatewayEvent events[CAPACITY];
+    int head;     // index of the oldest event
+    int count;
+    uint32_t dropped;
+};
+
+#endif // EVENTQUEUE_H
@@ -0,0 +1,121 @@
+#include "LoadShedder.h"
+
+LoadShedder::LoadShedder()
+    : plugPtr(nullptr), telemetryPtr(nullptr), budget(0), hysteresis(0), lastActionMs(0),
+      shedCount(0), restoreCount(0), lastReactionMs(0), maxReactionMs(0) {}
+
+void LoadShedder::begin(TasmotaPlugs& plugs, Telemetry& telemetry, DebugOutput& logger) {
+    plugPtr = &plugs;
+    telemetryPtr = &telemetry;
+    log = logger;
+    budget = plugs.config.power_budget;
+    hysteresis = plugs.config.power_hysteresis;
+
+    size_t count = plugs.plugs.size();
+    priority.assign(count, 0);
+    for (size_t i = 0; i < count && i < plugs.config.plug_priority.size(); i++) {
+        priority[i] = plugs.config.plug_priority[i];
+    }
+    shed.assign(count, false);
+    shedPower.assign(count, 0);
+    if (enabled()) {
+        log.info("Load shedding enabled, budget %d W, hysteresis %d W\n", (int)budget, (int)hysteresis);
+    }
+}
+
+void LoadShedder::onSample(int ipIndex) {
+    if (!enabled() || ipIndex < 0) {
+        return;
+    }
+    // also runs for a reading taken by an Energy command, whose replay does not shed
+    TasmotaPlugs::OriginScope scope(*plugPtr, TrafficTrace::HTTP_BACKGROUND);
+    unsigned long sampleMs = telemetryPtr->sample(ipIndex).timeMs;
+    float total = telemetryPtr->totalPower();
+
+    while (total > budget) {
+        int victim = findSheddable();
+        if (victim < 0) {
+            log.error("Power %d W is over budget and no plug can be shed\n", (int)total);
+            return;
+        }
+        PlugSample& victimSample = telemetryPtr->sample(victim);
+        int result = plugPtr->setPlugState(victim, 0, false);
+        if (result != TasmotaPlugs::RET_SUCCESS) {
+            log.error("Unable to shed plug %d: %s\n", victim, TasmotaPlugs::getErrorString(result));
+            return;  // try again on the next sample
+        }
+        lastActionMs = millis();
+        lastReactionMs = lastActionMs - sampleMs;
+        if (lastReactionMs > maxReactionMs) {
+            maxReactionMs = lastReactionMs;
+        }
+        shedCount++;
+        shed[victim] = true;
+        shedPower[victim] = victimSample.values.Power;
+        victimSample.values.Power = 0;  // the plug is off, don't wait for the next poll to count that
+        log.info("Shed plug %d (%d W), total was %d W, reaction %lu ms\n", victim, (int)shedPower[victim],
+                 (int)total, lastReactionMs);
+        total = telemetryPtr->totalPower();
+    }
+
+    if (millis() - lastActionMs < RESTORE_HOLDOFF_MS) {
+        return;
+    }
+    int candidate = findRestorable(total);
+    if (candidate >= 0) {
+        int result = plugPtr->setPlugState(candidate, 0, true);
+        if (result == TasmotaPlugs::RET_SUCCESS) {
+            lastActionMs = millis();
+            restoreCount++;
+            shed[candidate] = false;
+            log.info("Restored plug %d, expected total %d W\n", candidate, (int)(total + shedPower[candidate]));
+        }
+    }
+}
+
+void LoadShedder::release(int ipIndex) {
+    if (ipIndex < 0 || (size_t)ipIndex >= shed.size() || !shed[ipIndex]) {
+        return;
+    }
+    shed[ipIndex] = false;
+    log.info("Plug %d was switched outside load shedding and is no longer shed\n", ipIndex);
+}
+
+// Returns the lowest priority plug that is drawing power, or -1 if there is none
+int LoadShedder::findSheddable() {
+    int victim = -1;
+    for (size_t i = 0; i < shed.size(); i++) {
+        PlugSample& plugSample = telemetryPtr->sample(i);
+        if (shed[i] || plugSample.timeMs == 0 || plugSample.values.Power <= 0) {
+            continue;
+        }
+        if (victim < 0 || priority[i] < priority[victim]) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+// Returns the highest priority shed plug whose load fits within the budget less hysteresis, or -1
+int LoadShedder::findRestorable(float total) {
+    int candidate = -1;
+    for (size_t i = 0; i < shed.size(); i++) {
+        if (!shed[i] || total + shedPower[i] > budget - hysteresis) {
+            continue;
+        }
+        if (candidate < 0 || priority[i] > priority[candidate]) {
+            candidate = i;
+        }
+    }
+    return candidate;
+}
+
+void LoadShedder::printStatus(Stream& outputStream) {
+    int shedPlugs = 0;
+    for (bool isShed : shed) {
+        shedPlugs += isShed ? 1 : 0;
+    }
+    outputStream.printf("shed|budget=%d,total=%d,shedPlugs=%d,shedCount=%lu,restoreCount=%lu,lastReactionMs=%lu,maxReactionMs=%lu\n",
+                        (int)budget, (int)(telemetryPtr ? telemetryPtr->totalPower() : 0), shedPlugs,
+                        (unsigned long)shedCount, (unsigned long)restoreCount, lastReactionMs, maxReactionMs);
+}
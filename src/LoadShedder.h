@@ -0,0 +1,56 @@
+#ifndef LOADSHEDDER_H
+#define LOADSHEDDER_H
+
+#include <vector>
+#include <Arduino.h>
+#include "TasmotaPlugs.h"
+#include "Telemetry.h"
+#include "DebugOutput.h"
+
+/*
+   Keeps the total power of all plugs within the configured budget.
+   When a telemetry sample takes the total over budget, plugs are switched off in order of
+   increasing priority until the total is within budget. A shed plug is switched back on,
+   highest priority first, once its last known load fits below the budget less the hysteresis.
+   Reaction latency is measured from the arrival of the over-budget sample to the
+   acknowledgement of the relay off command.
+*/
+class LoadShedder {
+public:
+    LoadShedder();
+    void begin(TasmotaPlugs& plugs, Telemetry& telemetry, DebugOutput& logger);
+    bool enabled() const { return budget > 0; }
+
+    // Evaluates the budget after telemetry has updated the sample of the given IP index
+    void onSample(int ipIndex);
+
+    // Called when a gateway command or a change made at the plug switches the relay. The plug is no
+    // longer restored by this controller, and can be shed again once it is switched back on
+    void release(int ipIndex);
+
+    void printStatus(Stream& outputStream = Serial);
+
+    static constexpr unsigned long RESTORE_HOLDOFF_MS = 10000;  // minimum time between shedding and restoring
+
+private:
+    TasmotaPlugs* plugPtr;
+    Telemetry* telemetryPtr;
+    DebugOutput log;
+
+    float budget;       // watts, 0 when disabled
+    float hysteresis;   // watts
+    std::vector<int> priority;
+    std::vector<bool> shed;          // plug was switched off by this controller
+    std::vector<float> shedPower;    // load of the plug when it was shed, used to decide when to restore
+
+    unsigned long lastActionMs;
+    uint32_t shedCount;
+    uint32_t restoreCount;
+    unsigned long lastReactionMs;
+    unsigned long maxReactionMs;
+
+    int findSheddable();
+    int findRestorable(float total);
+};
+
+#endif // LOADSHEDDER_H
@@ -0,0 +1,85 @@
+#include "PlugMonitor.h"
+
+PlugMonitor::PlugMonitor()
+    : plugPtr(nullptr), eventPtr(nullptr), rssiThreshold(0), periodMs(5000), nextPollMs(0), nextIndex(0),
+      listener(nullptr) {}
+
+void PlugMonitor::begin(TasmotaPlugs& plugs, EventQueue& events, DebugOutput& logger, uint32_t period) {
+    plugPtr = &plugs;
+    eventPtr = &events;
+    log = logger;
+    periodMs = period;
+    rssiThreshold = plugs.config.rssi_threshold;
+    // plugs start out reachable so that a plug missing at startup raises an event
+    watches.assign(plugs.plugs.size(), Watch{0, true, false, 0});
+    nextPollMs = millis();
+    nextIndex = 0;
+}
+
+void PlugMonitor::setListener(RelayListener relayListener) {
+    listener = relayListener;
+}
+
+int PlugMonitor::service() {
+    if (plugPtr == nullptr || watches.empty() || (long)(millis() - nextPollMs) < 0 || !plugPtr->requestBudgetAvailable()) {
+        return -1;
+    }
+    nextPollMs += periodMs / watches.size();
+    if ((long)(millis() - nextPollMs) > (long)periodMs) {
+        nextPollMs = millis();
+    }
+    int ipIndex = nextIndex;
+    nextIndex = (nextIndex + 1) % watches.size();
+    if (plugPtr->plugs[ipIndex].empty()) {
+        return -1;   // no plugs configured at this address
+    }
+    checkPlug(ipIndex);
+    return ipIndex;
+}
+
+void PlugMonitor::checkPlug(int ipIndex) {
+    Watch& watch = watches[ipIndex];
+    PlugState& plug = plugPtr->plugs[ipIndex][0];
+    StateStatus status;
+    int result = plugPtr->getStateStatus(ipIndex, 0, status, TasmotaPlugs::BACKGROUND_TIMEOUT_MS);
+
+    if (result != TasmotaPlugs::RET_SUCCESS) {
+        if (++watch.failures == UNREACHABLE_COUNT && watch.reachable) {
+            watch.reachable = false;
+            eventPtr->push(EVENT_PLUG_UNREACHABLE, ipIndex, 0, result);
+            log.info("Plug at %s is unreachable\n", plug.url);
+        }
+        return;
+    }
+    watch.failures = 0;
+
+    if (!watch.reachable) {
+        watch.reachable = true;
+        eventPtr->push(EVENT_PLUG_REACHABLE, ipIndex, 0, status.power);
+        log.info("Plug at %s is reachable\n", plug.url);
+    } else if (status.uptimeSec < watch.uptimeSec) {
+        eventPtr->push(EVENT_PLUG_RESTARTED, ipIndex, 0, status.power);
+        log.info("Plug at %s has restarted\n", plug.url);
+    }
+    watch.uptimeSec = status.uptimeSec;
+
+    // gateway commands update plugState, so a difference here was caused by something else
+    if (plug.plugState >= 0 && status.power != plug.plugState) {
+        eventPtr->push(EVENT_RELAY_CHANGED, ipIndex, 0, status.power);
+        log.info("Plug at %s was switched %s externally\n", plug.url, status.power ? "ON" : "OFF");
+        if (listener != nullptr) {
+            listener(ipIndex);
+        }
+    }
+    for (PlugState& subPlug : plugPtr->plugs[ipIndex]) {
+        subPlug.plugState = status.power;
+    }
+
+    if (!watch.rssiLow && status.rssi < rssiThreshold) {
+        watch.rssiLow = true;
+        eventPtr->push(EVENT_RSSI_LOW, ipIndex, 0, status.rssi);
+    } else if (watch.rssiLow && status.rssi >= rssiThreshold + RSSI_HYSTERESIS) {
+        watch.rssiLow = false;
+        eventPtr->push(EVENT_RSSI_OK, ipIndex, 0, status.rssi);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef PLUGMONITOR_H
+#define PLUGMONITOR_H
+
+#include <vector>
+#include <Arduino.h>
+#include "TasmotaPlugs.h"
+#include "EventQueue.h"
+#include "DebugOutput.h"
+
+/*
+   Polls Status 11 of each plug in turn and queues an event when the relay state,
+   reachability or signal strength changes without a gateway command, for example
+   when the plug button is pressed or the plug restarts.
+*/
+class PlugMonitor {
+public:
+    typedef void (*RelayListener)(int ipIndex);   // called when a relay was switched outside the gateway
+
+    PlugMonitor();
+    void begin(TasmotaPlugs& plugs, EventQueue& events, DebugOutput& logger, uint32_t periodMs);
+    void setListener(RelayListener relayListener);
+
+    // Polls the next plug if it is due and the request budget has a free slot,
+    // returns its IP index or -1 if nothing was polled
+    int service();
+
+    static constexpr int UNREACHABLE_COUNT = 2;   // consecutive failed polls before a plug is unreachable
+    static constexpr int RSSI_HYSTERESIS = 5;     // percent above the threshold before signal is ok again
+
+private:
+    struct Watch {
+        int failures;
+        bool reachable;
+        bool rssiLow;
+        uint32_t uptimeSec;
+    };
+
+    TasmotaPlugs* plugPtr;
+    EventQueue* eventPtr;
+    DebugOutput log;
+    std::vector<Watch> watches;
+    int rssiThreshold;
+    uint32_t periodMs;
+    unsigned long nextPollMs;
+    size_t nextIndex;
+    RelayListener listener;
+
+    void checkPlug(int ipIndex);
+};
+
+#endif // PLUGMONITOR_H
@@ -0,0 +1,74 @@
+#include "SoakTest.h"
+
+SoakTest::SoakTest()
+    : plugPtr(nullptr), output(&Serial), remaining(0), sent(0), failures(0), reportEvery(DEFAULT_REPORT_EVERY),
+      startMs(0), startMaxAlloc(0), lowestMaxAlloc(0), nextIndex(0), nextRequest(0) {}
+
+void SoakTest::begin(TasmotaPlugs& plugs, Stream& outputStream) {
+    plugPtr = &plugs;
+    output = &outputStream;
+}
+
+void SoakTest::start(uint32_t requests, uint32_t every) {
+    if (remaining > 0) {
+        report();   // results of the run being replaced
+    }
+    remaining = requests;
+    reportEvery = every > 0 ? every : DEFAULT_REPORT_EVERY;
+    sent = 0;
+    failures = 0;
+    startMs = millis();
+    startMaxAlloc = lowestMaxAlloc = ESP.getMaxAllocHeap();
+    nextIndex = 0;
+    nextRequest = 0;
+    if (remaining > 0) {
+        report();
+    }
+}
+
+void SoakTest::service() {
+    if (remaining == 0 || plugPtr == nullptr || plugPtr->plugs.empty()) {
+        return;
+    }
+    int ipIndex = nextIndex;
+    nextIndex = (nextIndex + 1) % plugPtr->plugs.size();
+    if (nextIndex == 0) {
+        nextRequest = (nextRequest + 1) % 4;   // each pass over the plugs uses the next request type
+    }
+    if (plugPtr->plugs[ipIndex].empty()) {
+        return;
+    }
+
+    if (sendNext(ipIndex) < 0) {
+        failures++;
+    }
+    sent++;
+    remaining--;
+    uint32_t maxAlloc = ESP.getMaxAllocHeap();
+    if (maxAlloc < lowestMaxAlloc) {
+        lowestMaxAlloc = maxAlloc;
+    }
+    if (sent % reportEvery == 0 || remaining == 0) {
+        report();
+    }
+}
+
+// Sends one read-only request, plugState is left alone so external changes are still detected
+int SoakTest::sendNext(int ipIndex) {
+    EnergyValues values;
+    StateStatus status;
+    switch (nextRequest) {
+        case 0: return plugPtr->getPlugState(plugPtr->plugs[ipIndex][0]);
+        case 1: return plugPtr->getRSSI(ipIndex, 0);
+        case 2: return plugPtr->getEnergyValues(ipIndex, 0, values);
+        default: return plugPtr->getStateStatus(ipIndex, 0, status);
+    }
+}
+
+void SoakTest::report() {
+    output->printf("soak|requests=%lu,remaining=%lu,failures=%lu,elapsedMs=%lu,free=%lu,maxAlloc=%lu,maxAllocStart=%lu,maxAllocLowest=%lu,minFree=%lu\n",
+                   (unsigned long)sent, (unsigned long)remaining, (unsigned long)failures,
+                   (unsigned long)(millis() - startMs), (unsigned long)ESP.getFreeHeap(),
+                   (unsigned long)ESP.getMaxAllocHeap(), (unsigned long)startMaxAlloc,
+                   (unsigned long)lowestMaxAlloc, (unsigned long)ESP.getMinFreeHeap());
+}
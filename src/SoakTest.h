@@ -0,0 +1,45 @@
+#ifndef SOAKTEST_H
+#define SOAKTEST_H
+
+#include <Arduino.h>
+#include "TasmotaPlugs.h"
+
+/*
+   Repeats read-only plug requests (power, RSSI, Status 10 and Status 11) across all plugs
+   and reports the heap as the run progresses, so a slow loss of the largest allocatable
+   block shows up before it causes failed requests. One request is sent per service() call.
+   Each report is a "soak|" line.
+*/
+class SoakTest {
+public:
+    SoakTest();
+    void begin(TasmotaPlugs& plugs, Stream& outputStream = Serial);
+
+    // Starts a run of the given number of requests, reporting every reportEvery requests. Zero stops a run
+    void start(uint32_t requests, uint32_t reportEvery = DEFAULT_REPORT_EVERY);
+    bool running() const { return remaining > 0; }
+
+    // Sends the next request of a run in progress, call from loop()
+    void service();
+
+    static constexpr uint32_t DEFAULT_REQUESTS = 1000;
+    static constexpr uint32_t DEFAULT_REPORT_EVERY = 100;
+
+private:
+    TasmotaPlugs* plugPtr;
+    Stream* output;
+    uint32_t remaining;
+    uint32_t sent;
+    uint32_t failures;
+    uint32_t reportEvery;
+    unsigned long startMs;
+    uint32_t startMaxAlloc;
+    uint32_t lowestMaxAlloc;
+    size_t nextIndex;
+    int nextRequest;
+
+    int sendNext(int ipIndex);
+    void report();
+};
+
+#endif // SOAKTEST_H
@@ -1,9 +1,26 @@
 #include "TasmotaPlugs.h"
-#include <HTTPClient.h>
+#include <WiFiClient.h>
 #include <ArduinoJson.h>
 #include "Config.h"
 
-TasmotaPlugs::TasmotaPlugs() {
+// URL encoded Tasmota command for each PlugCommand
+#define PLUG_COMMAND_STRING(id, command) command,
+static const char* const commandStrings[PLUG_CMD_COUNT] = {
+    TASMOTA_COMMANDS(PLUG_COMMAND_STRING)
+};
+#undef PLUG_COMMAND_STRING
+
+// HTTP/1.0 so the reply is never chunked and the plug closes the connection when done
+#define PLUG_REQUEST(command, host) "GET /cm?cmnd=" command " HTTP/1.0\r\nHost: " host "\r\n\r\n"
+
+// Every prepared request has to fit its slot in PlugState with the longest host address
+#define PLUG_REQUEST_FITS(id, command) \
+    static_assert(sizeof(PLUG_REQUEST(command, "192.168.4.255")) <= PLUG_REQUEST_SIZE, \
+                  "request for " #id " does not fit PLUG_REQUEST_SIZE");
+TASMOTA_COMMANDS(PLUG_REQUEST_FITS)
+#undef PLUG_REQUEST_FITS
+
+TasmotaPlugs::TasmotaPlugs() : reconcileLock(portMUX_INITIALIZER_UNLOCKED) {
     // Constructor body, if needed
 }
 
@@ -17,6 +34,7 @@ void TasmotaPlugs::begin(DebugOutput& Logger) {
 
     // Initialize plug states based on loaded configuration
     initPlugStates();
+    setRequestRate(config.telemetry_rate);
 
     // Optionally print configuration data for debugging
     showPlugConfiguration();
@@ -26,7 +44,7 @@ void TasmotaPlugs::showPlugConfiguration() {
     for (size_t ipIndex = 0; ipIndex < plugs.size(); ++ipIndex) {
         for (size_t subPlugIndex = 0; subPlugIndex < plugs[ipIndex].size(); ++subPlugIndex) {
             PlugState &plug = plugs[ipIndex][subPlugIndex];
-            log.info("Device at IP %s%d has index %zu, subIndex %zu\n",  ip_base_url.c_str(), plug.ip_octet, ipIndex, subPlugIndex);
+            log.info("Device at IP %s has index %zu, subIndex %zu\n", plug.url, ipIndex, subPlugIndex);
         }
     }
     log.info("\n");  
@@ -42,97 +60,296 @@ void TasmotaPlugs::initPlugStates() {
             newPlug.sub_plug_index = subPlugIndex;
             newPlug.pin = config.esp_pin_map[ipIndex];
             newPlug.pinState = defaultPinState;
+            newPlug.plugState = defaultPlugState;
+            prepareRequests(newPlug);
             subPlugs.push_back(newPlug);
         }
         plugs.push_back(subPlugs);
     }
+
+    // one receive buffer per IP address so every startup reconciliation task can run at once
+    if (!responseBuffers.begin(plugs.size())) {
+        log.error("Unable to allocate response buffers\n");
+    }
+}
+
+// Builds the url and the complete HTTP request for every command so sending needs no string handling
+void TasmotaPlugs::prepareRequests(PlugState& plug) {
+    snprintf(plug.host, sizeof(plug.host), "%d.%d.%d.%d", subnet[0], subnet[1], subnet[2], plug.ip_octet);
+    snprintf(plug.url, sizeof(plug.url), "http://%s", plug.host);
+    for (int cmd = 0; cmd < PLUG_CMD_COUNT; cmd++) {
+        snprintf(plug.request[cmd], PLUG_REQUEST_SIZE, PLUG_REQUEST("%s", "%s"), commandStrings[cmd], plug.host);
+    }
+}
+
+void TasmotaPlugs::setTrace(TrafficTrace* traffic) {
+    trace = traffic;
+}
+
+void TasmotaPlugs::setRequestRate(float requestsPerSecond) {
+    requestSpacingMs = requestsPerSecond > 0 ? (uint32_t)(1000 / requestsPerSecond) : 1000;
+}
+
+// Sends a prepared request and reads the reply into buffer, which must hold BufferPool::BLOCK_SIZE bytes.
+// Returns the HTTP status code with body pointing to the null terminated body, or a negative error code
+int TasmotaPlugs::sendRequest(PlugState& plug, PlugCommand cmd, char* buffer, char** body, uint16_t timeoutMs) {
+    requestCount++;
+    if (trace != nullptr && trace->isReplaying()) {
+        return trace->replayHttp(plug.ip_octet, cmd, buffer, BufferPool::BLOCK_SIZE, body);
+    }
+    uint32_t startUs = micros();
+    int httpCode = exchange(plug, cmd, buffer, body, timeoutMs);
+    lastRequestMs = millis();
+    if (trace != nullptr && trace->isCapturing()) {
+        const char* data = (httpCode > 0) ? *body : nullptr;
+        trace->recordHttp(plug.ip_octet, cmd, origin, httpCode, micros() - startUs, data, data ? strlen(data) : 0);
+    }
+    return httpCode;
+}
+
+int TasmotaPlugs::exchange(PlugState& plug, PlugCommand cmd, char* buffer, char** body, uint16_t timeoutMs) {
+    WiFiClient client;
+    if (!client.connect(IPAddress(subnet[0], subnet[1], subnet[2], plug.ip_octet), 80, timeoutMs)) {
+        return ERR_HTTP_REQUEST_FAILED;
+    }
+    const char* request = plug.request[cmd];
+    client.write(reinterpret_cast<const uint8_t*>(request), strlen(request));
+
+    size_t length = 0;
+    unsigned long startTime = millis();
+    while (length < BufferPool::BLOCK_SIZE - 1) {
+        int available = client.available();
+        if (available > 0) {
+            size_t space = BufferPool::BLOCK_SIZE - 1 - length;
+            int count = client.read(reinterpret_cast<uint8_t*>(buffer + length), (size_t)available < space ? available : space);
+            if (count > 0) {
+                length += count;
+            }
+        } else if (!client.connected()) {
+            break;  // plug has sent the complete reply
+        } else if (millis() - startTime >= timeoutMs) {
+            client.stop();
+            return ERR_HTTP_REQUEST_FAILED;
+        } else {
+            delay(1);
+        }
+    }
+    client.stop();
+    buffer[length] = '\0';
+
+    // status line is "HTTP/1.x nnn reason", the body follows the first blank line
+    if (length < 12 || strncmp(buffer, "HTTP/1.", 7) != 0) {
+        return ERR_HTTP_REQUEST_FAILED;
+    }
+    char* separator = strstr(buffer, "\r\n\r\n");
+    *body = (separator != nullptr) ? separator + 4 : buffer + length;
+    return atoi(buffer + 9);
 }
 
 int TasmotaPlugs::getPlugState(int ipIndex, int subPlugIndex) {
-    if (ipIndex >= plugs.size() || subPlugIndex >= plugs[ipIndex].size()) {
+    if (!validIndex(ipIndex, subPlugIndex)) {
         return ERR_PLUG_REF_INVALID;
     }
     PlugState* plug = &plugs[ipIndex][subPlugIndex];
-    return getPlugState(getIPAddress(*plug));
+    int state = getPlugState(*plug);
+    if (state >= 0) {
+        plug->plugState = state;
+    }
+    return state;
 }
 
-int TasmotaPlugs::getPlugState(const std::string& url) {
-    log.debug("getting state for plag at %s\n", url.c_str());
-    HTTPClient http;
-    std::string command = url +  "/cm?cmnd=Power";
-    http.begin(command.c_str());
-    int httpCode = http.GET();
-    if (httpCode != HTTP_CODE_OK) {
-        http.end();
-        return ERR_HTTP_REQUEST_FAILED;
+int TasmotaPlugs::getPlugState(PlugState& plug, uint16_t timeoutMs) {
+    log.debug("getting state for plag at %s\n", plug.url);
+    return query(plug, CMD_POWER_QUERY, timeoutMs, [](char* body, void*) { return parsePowerState(body); }, nullptr);
+}
+
+// Queries every configured IP address concurrently and seeds plugState with the reply.
+// Returns the number of IP addresses that answered before timeoutMs elapsed.
+int TasmotaPlugs::reconcilePlugStates(uint32_t timeoutMs) {
+    if (reconcileDone == nullptr) {
+        reconcileDone = xSemaphoreCreateCounting(plugs.size() > 0 ? plugs.size() : 1, 0);
+    }
+    while (xSemaphoreTake(reconcileDone, 0) == pdTRUE) {
+        // discard completions left over from an earlier call
     }
+    unsigned long startTime = millis();
 
-    StaticJsonDocument<200> doc;
-    DeserializationError error = deserializeJson(doc, http.getString());
-    http.end();
-    if (error) {
-        return ERR_JSON_ERROR;
+    std::vector<ReconcileJob*> jobs;
+    for (size_t ipIndex = 0; ipIndex < plugs.size(); ++ipIndex) {
+        if (plugs[ipIndex].empty()) {
+            continue;   // no plugs configured at this address
+        }
+        ReconcileJob* job = new ReconcileJob{this, (int)ipIndex, plugs[ipIndex][0], startTime + timeoutMs,
+                                             ERR_HTTP_REQUEST_FAILED, false, false};
+        if (xTaskCreate(reconcileTask, "reconcile", 6144, job, 1, nullptr) == pdPASS) {
+            jobs.push_back(job);
+        } else {
+            log.error("Unable to start reconcile task for plug at %s\n", job->plug.url);
+            delete job;
+        }
     }
 
-    const char* state = doc["POWER"];
-    return (strcmp(state, "ON") == 0) ? 1 : 0;
+    // each task gives the semaphore once, so completion time is that of the slowest plug
+    size_t finished = 0;
+    while (finished < jobs.size()) {
+        unsigned long elapsed = millis() - startTime;
+        // allow one HTTP timeout past the deadline for requests still in flight
+        unsigned long limit = timeoutMs + HTTP_TIMEOUT_MS;
+        if (elapsed >= limit || xSemaphoreTake(reconcileDone, pdMS_TO_TICKS(limit - elapsed)) != pdTRUE) {
+            log.error("Plug state reconciliation timed out with %d tasks outstanding\n", (int)(jobs.size() - finished));
+            break;
+        }
+        finished++;
+    }
+
+    int answered = 0;
+    for (ReconcileJob* job : jobs) {
+        portENTER_CRITICAL(&reconcileLock);
+        bool done = job->done;
+        job->abandoned = !done;   // an unfinished task now owns its job and frees it when it ends
+        portEXIT_CRITICAL(&reconcileLock);
+        if (!done) {
+            log.info("Plug at %s did not answer\n", job->plug.url);
+            continue;
+        }
+        if (job->state >= 0) {
+            answered++;
+            for (PlugState& plug : plugs[job->ipIndex]) {
+                plug.plugState = job->state;
+            }
+            log.info("Plug at %s is %s\n", job->plug.url, job->state ? "ON" : "OFF");
+        } else {
+            log.info("Plug at %s did not answer\n", job->plug.url);
+        }
+        delete job;
+    }
+    return answered;
+}
+
+void TasmotaPlugs::reconcileTask(void* param) {
+    ReconcileJob* job = static_cast<ReconcileJob*>(param);
+    TasmotaPlugs* self = job->owner;
+    // plugs may still be associating with the access point, so retry until the deadline
+    int state = ERR_HTTP_REQUEST_FAILED;
+    while ((long)(job->deadline - millis()) > 0) {
+        unsigned long remaining = job->deadline - millis();
+        state = self->getPlugState(job->plug, remaining < HTTP_TIMEOUT_MS ? remaining : HTTP_TIMEOUT_MS);
+        if (state >= 0) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(250));
+    }
+
+    portENTER_CRITICAL(&self->reconcileLock);
+    bool abandoned = job->abandoned;
+    job->state = state;
+    job->done = true;
+    portEXIT_CRITICAL(&self->reconcileLock);
+    if (abandoned) {
+        delete job;
+    } else {
+        xSemaphoreGive(self->reconcileDone);
+    }
+    vTaskDelete(nullptr);
 }
 
 int TasmotaPlugs::setPlugState(int ipIndex, int subPlugIndex, bool state) {
-    if (ipIndex >= plugs.size() || subPlugIndex >= plugs[ipIndex].size()) {
+    if (!validIndex(ipIndex, subPlugIndex)) {
         return ERR_PLUG_REF_INVALID;
     }
     PlugState* plug = &plugs[ipIndex][subPlugIndex];
-    return setPlugState(getIPAddress(*plug), state);
+    int result = setPlugState(*plug, state);
+    if (result == RET_SUCCESS) {
+        plug->plugState = state ? 1 : 0;
+    }
+    return result;
 }
 
-int TasmotaPlugs::setPlugState(const std::string& url, bool state) {
-    HTTPClient http;
-    std::string command = url + (state ? "/cm?cmnd=Power%20On" : "/cm?cmnd=Power%20Off");
-    http.begin(command.c_str());
-    int httpCode = http.GET();
-    http.end();
-    return (httpCode == HTTP_CODE_OK) ? RET_SUCCESS : ERR_TASMOTA_REQUEST_FAILED;
+int TasmotaPlugs::setPlugState(PlugState& plug, bool state) {
+    char* buffer = responseBuffers.acquire(HTTP_TIMEOUT_MS);
+    if (buffer == nullptr) {
+        return ERR_TASMOTA_REQUEST_FAILED;
+    }
+    char* body = nullptr;
+    int httpCode = sendRequest(plug, state ? CMD_POWER_ON : CMD_POWER_OFF, buffer, &body, HTTP_TIMEOUT_MS);
+    responseBuffers.release(buffer);
+    return (httpCode == 200) ? RET_SUCCESS : ERR_TASMOTA_REQUEST_FAILED;
 }
 
- int TasmotaPlugs::getRSSI(int ipIndex, int subPlugIndex){
-    PlugState* plug = &plugs[ipIndex][subPlugIndex];
- 
-    HTTPClient http;
-    std::string command = getIPAddress(*plug) + "/cm?cmnd=Status%2011";
-    http.begin(command.c_str());
-    int httpCode = http.GET();
-    if (httpCode != HTTP_CODE_OK) {
-        http.end();
+int TasmotaPlugs::getRSSI(int ipIndex, int subPlugIndex) {
+    int result = query(ipIndex, subPlugIndex, CMD_STATUS_11, HTTP_TIMEOUT_MS,
+                       [](char* body, void*) { return parseRSSI(body); }, nullptr);
+    if (result == ERR_JSON_ERROR) {
+        log.error("heap free = %ld\n", ESP.getMaxAllocHeap());
+    }
+    return result;
+}
+
+int TasmotaPlugs::getEnergyValues(int ipIndex, int subPlugIndex, EnergyValues& values, uint16_t timeoutMs) {
+    return query(ipIndex, subPlugIndex, CMD_STATUS_10, timeoutMs,
+                 [](char* body, void* values) { return parseEnergyValues(body, *static_cast<EnergyValues*>(values)); },
+                 &values);
+}
+
+int TasmotaPlugs::getStateStatus(int ipIndex, int subPlugIndex, StateStatus& status, uint16_t timeoutMs) {
+    return query(ipIndex, subPlugIndex, CMD_STATUS_11, timeoutMs,
+                 [](char* body, void* status) { return parseStateStatus(body, *static_cast<StateStatus*>(status)); },
+                 &status);
+}
+
+bool TasmotaPlugs::validIndex(int ipIndex, int subPlugIndex) const {
+    return ipIndex >= 0 && (size_t)ipIndex < plugs.size() &&
+           subPlugIndex >= 0 && (size_t)subPlugIndex < plugs[ipIndex].size();
+}
+
+int TasmotaPlugs::query(int ipIndex, int subPlugIndex, PlugCommand cmd, uint16_t timeoutMs, ReplyParser parse,
+                        void* result) {
+    if (!validIndex(ipIndex, subPlugIndex)) {
+        return ERR_PLUG_REF_INVALID;
+    }
+    return query(plugs[ipIndex][subPlugIndex], cmd, timeoutMs, parse, result);
+}
+
+int TasmotaPlugs::query(PlugState& plug, PlugCommand cmd, uint16_t timeoutMs, ReplyParser parse, void* result) {
+    char* buffer = responseBuffers.acquire(timeoutMs);
+    if (buffer == nullptr) {
         return ERR_HTTP_REQUEST_FAILED;
     }
+    char* body = nullptr;
+    int httpCode = sendRequest(plug, cmd, buffer, &body, timeoutMs);
+    int code = (httpCode == 200) ? parse(body, result) : ERR_HTTP_REQUEST_FAILED;
+    responseBuffers.release(buffer);
+    return code;
+}
 
-    StaticJsonDocument<600> doc;
-    DeserializationError error = deserializeJson(doc, http.getString());
-    http.end();
+// The JSON documents are on the stack and deserialized in place, so parsing does not touch the heap
+int TasmotaPlugs::parsePowerState(char* json) {
+    StaticJsonDocument<200> doc;
+    DeserializationError error = deserializeJson(doc, json);
     if (error) {
-        log.error("DeserializationError: %s\n", error.c_str());
-        log.error("heap free = %ld\n", ESP.getMaxAllocHeap());
         return ERR_JSON_ERROR;
     }
 
-    return doc["StatusSTS"]["Wifi"]["RSSI"]; // Assuming RSSI is directly accessible and valid
+    const char* state = doc["POWER"];
+    if (state == nullptr) {
+        return ERR_UNKNOWN_STATE;
+    }
+    return (strcmp(state, "ON") == 0) ? 1 : 0;
 }
 
- int TasmotaPlugs::getEnergyValues(int ipIndex, int subPlugIndex, EnergyValues& values) {
-    PlugState* plug = &plugs[ipIndex][subPlugIndex];
-    HTTPClient http;
-    std::string command = getIPAddress(*plug) + "/cm?cmnd=Status%2010";
-    http.begin(command.c_str());
-    int httpCode = http.GET();
-    if (httpCode != HTTP_CODE_OK) {
-        http.end();
-        return ERR_HTTP_REQUEST_FAILED;
+int TasmotaPlugs::parseRSSI(char* json) {
+    StaticJsonDocument<600> doc;
+    DeserializationError error = deserializeJson(doc, json);
+    if (error) {
+        return ERR_JSON_ERROR;
     }
 
+    return doc["StatusSTS"]["Wifi"]["RSSI"]; // Assuming RSSI is directly accessible and valid
+}
+
+int TasmotaPlugs::parseEnergyValues(char* json, EnergyValues& values) {
     StaticJsonDocument<500> doc;
-    DeserializationError error = deserializeJson(doc, http.getString());
-    http.end();
+    DeserializationError error = deserializeJson(doc, json);
     if (error) {
         return ERR_JSON_ERROR;
     }
@@ -149,23 +366,36 @@ int TasmotaPlugs::setPlugState(const std::string& url, bool state) {
     return RET_SUCCESS;
 }
 
+int TasmotaPlugs::parseStateStatus(char* json, StateStatus& status) {
+    StaticJsonDocument<600> doc;
+    DeserializationError error = deserializeJson(doc, json);
+    if (error) {
+        return ERR_JSON_ERROR;
+    }
+
+    JsonObject StatusSTS = doc["StatusSTS"];
+    const char* power = StatusSTS["POWER"];
+    if (power == nullptr) {
+        return ERR_UNKNOWN_STATE;
+    }
+    status.power = (strcmp(power, "ON") == 0) ? 1 : 0;
+    status.rssi = StatusSTS["Wifi"]["RSSI"] | 0;
+    status.uptimeSec = StatusSTS["UptimeSec"] | 0;
+    return RET_SUCCESS;
+}
+
+void TasmotaPlugs::printHeapStats(Stream& outputStream) {
+    outputStream.printf("heap|requests=%lu,free=%lu,maxAlloc=%lu,minFree=%lu,buffers=%d/%d\n",
+                        (unsigned long)requestCount, (unsigned long)ESP.getFreeHeap(),
+                        (unsigned long)ESP.getMaxAllocHeap(), (unsigned long)ESP.getMinFreeHeap(),
+                        responseBuffers.available(), responseBuffers.size());
+}
+
 
 const char* TasmotaPlugs::getErrorString(int errorCode) {
-    switch (errorCode) {
-        case RET_SUCCESS: return "Success";
-        case ERR_URL_PREPARATION_FAILED: return "URL preparation failed";
-        case ERR_HTTP_REQUEST_FAILED: return "HTTP request failed";
-        case ERR_JSON_ERROR: return "JSON parsing error";
-        case ERR_UNKNOWN_STATE: return "Unknown state";
-        case ERR_PLUG_NOT_CONNECTED: return "Plug not connected";
-        case ERR_TASMOTA_REQUEST_FAILED: return "Tasmota request failed";
-        case ERR_PLUG_REF_INVALID: return "Invalid plug reference";
-        default: return "Unknown error";
-    }
-}
-
-std::string TasmotaPlugs::getIPAddress(PlugState& plug) {
-    // Construct the full URL using the ip_octet from the plug
-    full_ip_address = ip_base_url + std::to_string(plug.ip_octet);
-    return full_ip_address;
+    return errorString(errorCode);
+}
+
+const char* TasmotaPlugs::getIPAddress(const PlugState& plug) {
+    return plug.url;
 }
@@ -4,60 +4,134 @@
 #include <vector>
 #include <string>
 #include <Arduino.h>
-#include "Config.h" 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "Config.h"
 #include "DebugOutput.h"
+#include "BufferPool.h"
+#include "TrafficTrace.h"
+#include "GatewayCommands.h"   // PlugCommand, one request per command is prepared when the plug is configured
+
+constexpr size_t PLUG_URL_SIZE = 24;      // "http://192.168.4.xxx" plus terminator
+constexpr size_t PLUG_HOST_SIZE = 16;     // "192.168.4.xxx" plus terminator
+constexpr size_t PLUG_REQUEST_SIZE = 72;  // HTTP request line and Host header
 
 struct PlugState {
     int ip_octet;         // Last octet of the IP address for the plug
     int sub_plug_index;   // Index of the plug at this IP address, used in SPI mode
     int pin;              // ESP digital pin number, used in pin control mode
     int pinState;         // Current state of the pin (HIGH or LOW), relevant in pin mode
+    int plugState;        // Last known relay state (1 = on, 0 = off), -1 if not yet known
+    char url[PLUG_URL_SIZE];                              // used for logging
+    char host[PLUG_HOST_SIZE];
+    char request[PLUG_CMD_COUNT][PLUG_REQUEST_SIZE];      // built once by prepareRequests
 };
 
 struct EnergyValues {
   float Voltage;     // Volts
   float Current;     // Amps
-  float Power;       // Watts 
+  float Power;       // Watts
   float Yesterday;   // kWatt hours
-  float Today;       // kWatt hours   
-  float Total;       // kWatt hours   
+  float Today;       // kWatt hours
+  float Total;       // kWatt hours
+};
+
+// Fields of the Status 11 reply used to detect changes made outside the gateway
+struct StateStatus {
+    int power;           // relay state, 1 = on, 0 = off
+    int rssi;            // wifi signal quality in percent
+    uint32_t uptimeSec;  // decreases when the plug restarts
 };
 
-class TasmotaPlugs {
+class TasmotaPlugs : public GatewayCodes {
 public:
     TasmotaPlugs();
     void begin(DebugOutput& Logger );
     void initPlugStates();
     int getPlugState(int ipIndex, int subPlugIndex) ;
-    int getPlugState(const std::string& url);
+    int getPlugState(PlugState& plug, uint16_t timeoutMs = HTTP_TIMEOUT_MS);
     int setPlugState(int ipIndex, int subPlugIndex, bool state) ;
-    int setPlugState(const std::string& url, bool state);
+    int setPlugState(PlugState& plug, bool state);
     int getRSSI(int ipIndex, int subPlugIndex);
-    int getEnergyValues(int ipIndex, int subPlugIndex, EnergyValues& values);
+    int getEnergyValues(int ipIndex, int subPlugIndex, EnergyValues& values, uint16_t timeoutMs = HTTP_TIMEOUT_MS);
+    int getStateStatus(int ipIndex, int subPlugIndex, StateStatus& status, uint16_t timeoutMs = HTTP_TIMEOUT_MS);
     static const char* getErrorString(int errorCode);
-    std::string getIPAddress(PlugState& plug); 
+    const char* getIPAddress(const PlugState& plug);
     void showPlugConfiguration();
+    int reconcilePlugStates(uint32_t timeoutMs);
+    void printHeapStats(Stream& outputStream = Serial);
+    void setTrace(TrafficTrace* traffic);
+
+    // Every request to a plug uses the shared access point airtime. Requests from the master are
+    // always sent, background polls are sent only when the budget has a free slot
+    void setRequestRate(float requestsPerSecond);
+    float getRequestRate() const { return 1000.0f / requestSpacingMs; }
+    bool requestBudgetAvailable() const { return millis() - lastRequestMs >= requestSpacingMs; }
+
+    // Extract values from a Tasmota JSON reply, the json buffer is modified in place
+    static int parsePowerState(char* json);
+    static int parseRSSI(char* json);
+    static int parseEnergyValues(char* json, EnergyValues& values);
+    static int parseStateStatus(char* json, StateStatus& status);
+
+    // Requests sent while an OriginScope exists are traced with its origin, the previous origin is
+    // restored when it ends. Requests outside any scope are background traffic
+    class OriginScope {
+    public:
+        OriginScope(TasmotaPlugs& owner, TrafficTrace::HttpOrigin origin) : owner(owner), saved(owner.origin) {
+            owner.origin = origin;
+        }
+        ~OriginScope() { owner.origin = saved; }
+    private:
+        TasmotaPlugs& owner;
+        TrafficTrace::HttpOrigin saved;
+    };
 
     std::vector<std::vector<PlugState>> plugs;// Vector of all plug states managed by this class
     Config config;  // Configuration object to manage config data
 
-    // Constants for operation status codes
-    static constexpr int RET_SUCCESS = 0;
-    static constexpr int ERR_URL_PREPARATION_FAILED = -1;
-    static constexpr int ERR_HTTP_REQUEST_FAILED = -2;
-    static constexpr int ERR_UNHANDLED_CASE = -3;
-    static constexpr int ERR_JSON_ERROR = -101;
-    static constexpr int ERR_UNKNOWN_STATE = -102;
-    static constexpr int ERR_PLUG_NOT_CONNECTED = -103;
-    static constexpr int ERR_TASMOTA_REQUEST_FAILED = -104;
-    static constexpr int ERR_PLUG_REF_INVALID = -105;
-
-private: 
-    std::string ip_base_url = "http://192.168.4."; // Default base URL
-    std::string full_ip_address;               // Temporary storage for the full IP address
+    static constexpr uint16_t HTTP_TIMEOUT_MS = 5000;  // default HTTP connect and read timeout
+    static constexpr uint16_t BACKGROUND_TIMEOUT_MS = 1000;  // background polls give up sooner so commands wait less
+
+private:
+    const uint8_t subnet[3] = {192, 168, 4};   // first three octets of the access point network
     static constexpr int defaultPinState = -1; // Default state for pins if no configuration is available
-    DebugOutput log; 
+    static constexpr int defaultPlugState = -1; // Relay state of a plug that has not yet been queried
+    DebugOutput log;
+
+    BufferPool responseBuffers;         // receive buffers shared by all requests
+    volatile uint32_t requestCount = 0; // requests sent since startup, reported with heap stats
+    uint32_t requestSpacingMs = 500;    // minimum time between background requests, from telemetry_rate
+    volatile unsigned long lastRequestMs = 0;   // millis() when the last request of any kind finished
+    TrafficTrace* trace = nullptr;      // records requests, or supplies replies when replaying
+    TrafficTrace::HttpOrigin origin = TrafficTrace::HTTP_BACKGROUND;   // set by OriginScope, from loop() only
+
+    // Parses the body of a reply with HTTP status 200 into result, returns a completion code
+    typedef int (*ReplyParser)(char* body, void* result);
+
+    void prepareRequests(PlugState& plug);
+    bool validIndex(int ipIndex, int subPlugIndex) const;
+    // Checks the plug reference, sends cmd with a pooled receive buffer and parses the reply
+    int query(int ipIndex, int subPlugIndex, PlugCommand cmd, uint16_t timeoutMs, ReplyParser parse, void* result);
+    int query(PlugState& plug, PlugCommand cmd, uint16_t timeoutMs, ReplyParser parse, void* result);
+    int sendRequest(PlugState& plug, PlugCommand cmd, char* buffer, char** body, uint16_t timeoutMs);
+    int exchange(PlugState& plug, PlugCommand cmd, char* buffer, char** body, uint16_t timeoutMs);
 
+    // Startup reconciliation runs one task per IP address, each querying its own copy of the plug
+    // until it answers. A job left running after the timeout is freed by its task, so the task never
+    // writes to plugs and reconcilePlugStates can return while requests are still in flight
+    struct ReconcileJob {
+        TasmotaPlugs* owner;
+        int ipIndex;
+        PlugState plug;
+        unsigned long deadline;
+        int state;        // result of the query, valid once done
+        bool done;        // set by the task when it has finished
+        bool abandoned;   // set when reconcilePlugStates stopped waiting for the task
+    };
+    SemaphoreHandle_t reconcileDone = nullptr;
+    portMUX_TYPE reconcileLock;         // guards done and abandoned
+    static void reconcileTask(void* param);
 };
 
 #endif // TASMOPLUGS_H
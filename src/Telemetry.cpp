@@ -0,0 +1,125 @@
+#include "Telemetry.h"
+
+Telemetry::Telemetry() : plugPtr(nullptr), maxIntervalMs(30000), listener(nullptr) {}
+
+void Telemetry::begin(TasmotaPlugs& plugs, DebugOutput& logger, uint32_t maxInterval) {
+    plugPtr = &plugs;
+    log = logger;
+    maxIntervalMs = maxInterval;
+    samples.assign(plugs.plugs.size(), PlugSample{{}, 0, TasmotaPlugs::ERR_UNKNOWN_STATE});
+    schedules.assign(plugs.plugs.size(), Schedule{0, 0, 0, 0, 0});
+}
+
+void Telemetry::setListener(SampleListener sampleListener) {
+    listener = sampleListener;
+}
+
+void Telemetry::setMaxInterval(uint32_t maxInterval) {
+    maxIntervalMs = maxInterval > MIN_INTERVAL_MS ? maxInterval : MIN_INTERVAL_MS;
+}
+
+uint32_t Telemetry::targetInterval(int ipIndex, unsigned long now) {
+    Schedule& schedule = schedules[ipIndex];
+    float interval = maxIntervalMs / (1 + schedule.deviation / DEVIATION_SCALE_W);
+    if (schedule.interestMs != 0 && now - schedule.interestMs < INTEREST_WINDOW_MS && interval > INTEREST_INTERVAL_MS) {
+        interval = INTEREST_INTERVAL_MS;
+    }
+    return constrain((uint32_t)interval, MIN_INTERVAL_MS, maxIntervalMs);
+}
+
+int Telemetry::service() {
+    unsigned long now = millis();
+    if (plugPtr == nullptr || samples.empty() || !plugPtr->requestBudgetAvailable()) {
+        return -1;
+    }
+
+    // poll the plug furthest past its target interval, plugs never polled come first
+    int ipIndex = -1;
+    float mostOverdue = 1;
+    for (size_t i = 0; i < schedules.size(); i++) {
+        float overdue = schedules[i].lastPollMs == 0 ? 1e9 : (float)(now - schedules[i].lastPollMs) / targetInterval(i, now);
+        if (overdue >= mostOverdue) {
+            mostOverdue = overdue;
+            ipIndex = i;
+        }
+    }
+    if (ipIndex < 0) {
+        return -1;
+    }
+
+    EnergyValues values;
+    int result = plugPtr->getEnergyValues(ipIndex, 0, values, TasmotaPlugs::BACKGROUND_TIMEOUT_MS);
+    if (result != TasmotaPlugs::RET_SUCCESS) {
+        log.debug("Telemetry for plug %d failed: %s\n", ipIndex, TasmotaPlugs::getErrorString(result));
+    }
+    record(ipIndex, result, values);
+    return ipIndex;
+}
+
+void Telemetry::record(int ipIndex, int result, const EnergyValues& values) {
+    unsigned long now = millis();
+    Schedule& schedule = schedules[ipIndex];
+    if (schedule.lastPollMs != 0) {
+        schedule.averageIntervalMs += DEVIATION_WEIGHT * ((now - schedule.lastPollMs) - schedule.averageIntervalMs);
+    }
+    schedule.lastPollMs = now;
+    schedule.polls++;
+
+    PlugSample& plugSample = samples[ipIndex];
+    plugSample.result = result;
+    if (result != TasmotaPlugs::RET_SUCCESS) {
+        return;
+    }
+    if (plugSample.timeMs != 0) {
+        float change = fabsf(values.Power - plugSample.values.Power);
+        schedule.deviation += DEVIATION_WEIGHT * (change - schedule.deviation);
+    }
+    plugSample.values = values;
+    plugSample.timeMs = now;
+    if (listener != nullptr) {
+        listener(ipIndex);
+    }
+}
+
+void Telemetry::noteInterest(int ipIndex) {
+    if (ipIndex >= 0 && (size_t)ipIndex < schedules.size()) {
+        schedules[ipIndex].interestMs = millis();
+        if (schedules[ipIndex].interestMs == 0) {
+            schedules[ipIndex].interestMs = 1;  // zero means never requested
+        }
+    }
+}
+
+void Telemetry::addSample(int ipIndex, const EnergyValues& values) {
+    if (ipIndex >= 0 && (size_t)ipIndex < samples.size()) {
+        record(ipIndex, TasmotaPlugs::RET_SUCCESS, values);
+    }
+}
+
+PlugSample& Telemetry::sample(int ipIndex) {
+    return samples[ipIndex];
+}
+
+float Telemetry::totalPower() {
+    float total = 0;
+    for (PlugSample& plugSample : samples) {
+        if (plugSample.timeMs != 0) {
+            total += plugSample.values.Power;
+        }
+    }
+    return total;
+}
+
+void Telemetry::printSchedule(Stream& outputStream) {
+    unsigned long now = millis();
+    for (size_t i = 0; i < schedules.size(); i++) {
+        Schedule& schedule = schedules[i];
+        bool interested = schedule.interestMs != 0 && now - schedule.interestMs < INTEREST_WINDOW_MS;
+        float pollsPerMinute = schedule.averageIntervalMs > 0 ? 60000 / schedule.averageIntervalMs : 0;
+        long staleness = samples[i].timeMs != 0 ? (long)(now - samples[i].timeMs) : -1;
+        outputStream.printf("sched|index=%d,targetMs=%lu,pollsPerMin=%.1f,stalenessMs=%ld,deviationW=%.1f,interest=%d,polls=%lu\n",
+                            (int)i, (unsigned long)targetInterval(i, now), pollsPerMinute, staleness,
+                            schedule.deviation, interested ? 1 : 0, (unsigned long)schedule.polls);
+    }
+    outputStream.printf("sched|budgetPerSec=%.1f,maxIntervalMs=%lu\n", plugPtr ? plugPtr->getRequestRate() : 0.0f, (unsigned long)maxIntervalMs);
+}
@@ -0,0 +1,69 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <vector>
+#include <Arduino.h>
+#include "TasmotaPlugs.h"
+#include "DebugOutput.h"
+
+// Latest energy reading from one IP address
+struct PlugSample {
+    EnergyValues values;
+    unsigned long timeMs;   // millis() when the reply arrived, 0 if never sampled
+    int result;             // completion code of the last request
+};
+
+/*
+   Polls the energy values of the configured plugs so other modules can work from fresh data.
+   Each plug has a target interval that shortens as its power changes more between samples
+   and while its data is being requested over I2C or serial. The plug furthest past its
+   target is polled next, but never faster than the requests per second budget allows.
+*/
+class Telemetry {
+public:
+    typedef void (*SampleListener)(int ipIndex);   // called after each successful reading
+
+    Telemetry();
+    void begin(TasmotaPlugs& plugs, DebugOutput& logger, uint32_t maxIntervalMs);
+    void setMaxInterval(uint32_t maxIntervalMs);
+    void setListener(SampleListener sampleListener);
+
+    // Polls the most overdue plug if the request budget has a free slot, returns its IP index or -1 if nothing was polled
+    int service();
+
+    // Records that a consumer asked for this plug's data, optionally with a reading it fetched itself
+    void noteInterest(int ipIndex);
+    void addSample(int ipIndex, const EnergyValues& values);
+
+    PlugSample& sample(int ipIndex);
+    float totalPower();   // sum of the latest power reading of every plug
+    size_t size() const { return samples.size(); }
+    void printSchedule(Stream& outputStream = Serial);
+
+    static constexpr uint32_t MIN_INTERVAL_MS = 1000;
+    static constexpr uint32_t INTEREST_INTERVAL_MS = 2000;  // target interval while a consumer is reading the plug
+    static constexpr uint32_t INTEREST_WINDOW_MS = 60000;   // how long a request keeps a plug of interest
+    static constexpr float DEVIATION_SCALE_W = 10;          // change in watts between samples that halves the interval
+    static constexpr float DEVIATION_WEIGHT = 0.3;          // weight of the newest change in the running average
+
+private:
+    struct Schedule {
+        unsigned long lastPollMs;   // 0 if never polled
+        unsigned long interestMs;   // 0 if never requested
+        float deviation;            // running average of the power change between samples, watts
+        float averageIntervalMs;    // running average of the time between polls
+        uint32_t polls;
+    };
+
+    TasmotaPlugs* plugPtr;
+    DebugOutput log;
+    std::vector<PlugSample> samples;
+    std::vector<Schedule> schedules;
+    uint32_t maxIntervalMs;
+    SampleListener listener;
+
+    uint32_t targetInterval(int ipIndex, unsigned long now);
+    void record(int ipIndex, int result, const EnergyValues& values);
+};
+
+#endif // TELEMETRY_H
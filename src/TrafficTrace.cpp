@@ -0,0 +1,223 @@
+#include "TrafficTrace.h"
+#include <LittleFS.h>
+#include "TasmotaPlugs.h"
+
+TrafficTrace::TrafficTrace()
+    : ringHead(0), ringTail(0), dropped(0), lock(portMUX_INITIALIZER_UNLOCKED), sink(SINK_NONE),
+      replaying(false), replayTimed(false), havePending(false), replayMismatches(0) {}
+
+void TrafficTrace::begin(DebugOutput& logger) {
+    log = logger;
+}
+
+bool TrafficTrace::startCapture(Sink newSink) {
+    stopCapture();
+    if (replaying) {
+        log.error("Cannot capture a trace while replaying\n");
+        return false;
+    }
+    if (newSink == SINK_FILE) {
+        traceFile = LittleFS.open(TRACE_FILE, "w");
+        if (!traceFile) {
+            log.error("Failed to open %s for writing\n", TRACE_FILE);
+            return false;
+        }
+    }
+    ringHead = ringTail = 0;
+    dropped = 0;
+    sink = newSink;
+    log.info("Trace capture started\n");
+    return true;
+}
+
+void TrafficTrace::stopCapture() {
+    if (sink == SINK_NONE) {
+        return;
+    }
+    service();
+    if (sink == SINK_FILE) {
+        traceFile.close();
+    }
+    sink = SINK_NONE;
+    log.info("Trace capture stopped, %lu records dropped\n", (unsigned long)dropped);
+}
+
+void TrafficTrace::service() {
+    if (sink == SINK_NONE) {
+        return;
+    }
+    // producers only write beyond head, so the bytes up to the snapshot can be written without the lock
+    portENTER_CRITICAL(&lock);
+    size_t head = ringHead;
+    portEXIT_CRITICAL(&lock);
+
+    while (ringTail != head) {
+        size_t start = ringTail % RING_SIZE;
+        size_t length = head - ringTail;
+        if (start + length > RING_SIZE) {
+            length = RING_SIZE - start;  // write up to the end of the ring, the rest on the next pass
+        }
+        writeToSink(ring + start, length);
+        portENTER_CRITICAL(&lock);
+        ringTail += length;
+        portEXIT_CRITICAL(&lock);
+    }
+}
+
+void TrafficTrace::writeToSink(const uint8_t* data, size_t length) {
+    if (sink == SINK_FILE) {
+        traceFile.write(data, length);
+    } else if (sink == SINK_SERIAL) {
+        encodeSerialLine(data, length, Serial);
+    }
+}
+
+void TrafficTrace::encodeSerialLine(const uint8_t* data, size_t length, Print& output) {
+    output.print("trace|");
+    for (size_t i = 0; i < length; i++) {
+        output.printf("%02x", data[i]);
+    }
+    output.println();
+}
+
+size_t TrafficTrace::decodeSerialLine(const char* line, uint8_t* data, size_t size) {
+    const char* hex = strstr(line, "trace|");
+    if (hex == nullptr) {
+        return 0;
+    }
+    hex += strlen("trace|");
+    size_t count = 0;
+    while (count < size && isxdigit((unsigned char)hex[0]) && isxdigit((unsigned char)hex[1])) {
+        char digits[3] = {hex[0], hex[1], '\0'};
+        data[count++] = (uint8_t)strtoul(digits, nullptr, 16);
+        hex += 2;
+    }
+    return count;
+}
+
+void TrafficTrace::append(const RecordHeader& header, const char* data) {
+    size_t total = sizeof(header) + header.dataLength;
+    portENTER_CRITICAL(&lock);
+    if (RING_SIZE - (ringHead - ringTail) < total) {
+        dropped++;
+        portEXIT_CRITICAL(&lock);
+        return;
+    }
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+    for (size_t i = 0; i < sizeof(header); i++) {
+        ring[(ringHead + i) % RING_SIZE] = bytes[i];
+    }
+    for (size_t i = 0; i < header.dataLength; i++) {
+        ring[(ringHead + sizeof(header) + i) % RING_SIZE] = data[i];
+    }
+    ringHead += total;
+    portEXIT_CRITICAL(&lock);
+}
+
+void TrafficTrace::recordI2cCommand(char cmd, int index, int subIndex, uint32_t waitUs) {
+    if (sink == SINK_NONE) {
+        return;
+    }
+    RecordHeader header = {TRACE_I2C_COMMAND, {(uint8_t)cmd, (uint8_t)index, (uint8_t)subIndex}, (uint32_t)micros(), waitUs, 0, 0};
+    append(header, nullptr);
+}
+
+void TrafficTrace::recordI2cReply(int completionCode, uint32_t durationUs) {
+    if (sink == SINK_NONE) {
+        return;
+    }
+    RecordHeader header = {TRACE_I2C_REPLY, {0, 0, 0}, (uint32_t)micros(), durationUs, (int16_t)completionCode, 0};
+    append(header, nullptr);
+}
+
+void TrafficTrace::recordHttp(int ipOctet, int cmd, HttpOrigin origin, int httpCode, uint32_t durationUs, const char* body,
+                              size_t length) {
+    if (sink == SINK_NONE) {
+        return;
+    }
+    RecordHeader header = {TRACE_HTTP, {(uint8_t)ipOctet, (uint8_t)cmd, origin}, (uint32_t)micros(), durationUs, (int16_t)httpCode,
+                           (uint16_t)(body != nullptr ? length : 0)};
+    append(header, body);
+}
+
+bool TrafficTrace::startReplay(bool timed) {
+    stopCapture();
+    traceFile = LittleFS.open(TRACE_FILE, "r");
+    if (!traceFile) {
+        log.error("Failed to open %s for replay\n", TRACE_FILE);
+        return false;
+    }
+    replaying = true;
+    replayTimed = timed;
+    havePending = false;
+    replayMismatches = 0;
+    replayBackground = 0;
+    return true;
+}
+
+void TrafficTrace::stopReplay() {
+    if (replaying) {
+        traceFile.close();
+        replaying = false;
+    }
+}
+
+bool TrafficTrace::nextRecord(RecordHeader& header) {
+    if (havePending) {
+        header = pending;
+        havePending = false;
+        return true;
+    }
+    return traceFile.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header);
+}
+
+void TrafficTrace::skipData(const RecordHeader& header) {
+    if (header.dataLength > 0) {
+        traceFile.seek(traceFile.position() + header.dataLength);
+    }
+}
+
+bool TrafficTrace::skipBackground(const RecordHeader& header) {
+    if (header.type != TRACE_HTTP || header.args[2] != HTTP_BACKGROUND) {
+        return false;
+    }
+    skipData(header);
+    replayBackground++;
+    return true;
+}
+
+// Serves the next recorded command reply in place of a network request, a background request
+// that finished while the command was waiting is passed over
+int TrafficTrace::replayHttp(int ipOctet, int cmd, char* buffer, size_t size, char** body) {
+    RecordHeader header;
+    do {
+        if (!nextRecord(header)) {
+            replayMismatches++;
+            return TasmotaPlugs::ERR_HTTP_REQUEST_FAILED;
+        }
+    } while (skipBackground(header));
+    if (header.type != TRACE_HTTP) {
+        // this firmware made a request the recorded one did not, leave the record for the caller
+        pending = header;
+        havePending = true;
+        replayMismatches++;
+        return TasmotaPlugs::ERR_HTTP_REQUEST_FAILED;
+    }
+    if (header.args[0] != ipOctet || header.args[1] != cmd) {
+        replayMismatches++;
+    }
+
+    size_t length = header.dataLength < size - 1 ? header.dataLength : size - 1;
+    traceFile.read(reinterpret_cast<uint8_t*>(buffer), length);
+    if (header.dataLength > length) {
+        traceFile.seek(traceFile.position() + header.dataLength - length);
+    }
+    buffer[length] = '\0';
+    *body = buffer;
+
+    if (replayTimed) {
+        delay(header.durationUs / 1000);
+        delayMicroseconds(header.durationUs % 1000);
+    }
+    return header.result;
+}
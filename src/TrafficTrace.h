@@ -0,0 +1,97 @@
+#ifndef TRAFFICTRACE_H
+#define TRAFFICTRACE_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "DebugOutput.h"
+
+/*
+   Captures I2C commands, the HTTP exchanges they cause and their timing as a compact
+   binary trace, and serves the recorded HTTP replies back when the trace is replayed.
+   Each record is a RecordHeader followed by dataLength bytes (the HTTP body for TRACE_HTTP).
+   Records are buffered in RAM and written to the sink by service(), so capture is cheap
+   to call from the I2C handlers and the reconcile tasks.
+*/
+class TrafficTrace {
+public:
+    enum Sink { SINK_NONE, SINK_FILE, SINK_SERIAL };
+
+    enum RecordType : uint8_t {
+        TRACE_I2C_COMMAND = 1,  // args: cmd, index, subIndex; duration: wait before service
+        TRACE_I2C_REPLY = 2,    // result: completion code; duration: time to handle the command
+        TRACE_HTTP = 3,         // args: ip octet, PlugCommand, HttpOrigin; result: HTTP code; duration: request time
+    };
+
+    // Replay reissues the recorded I2C commands, so only the requests they made are expected again.
+    // Polls, load shedding and pin switching are recorded as background traffic and skipped
+    enum HttpOrigin : uint8_t {
+        HTTP_COMMAND = 0,       // made while handling an I2C command
+        HTTP_BACKGROUND = 1,
+    };
+
+    struct __attribute__((packed)) RecordHeader {
+        uint8_t type;
+        uint8_t args[3];
+        uint32_t timestampUs;
+        uint32_t durationUs;
+        int16_t result;
+        uint16_t dataLength;
+    };
+
+    static constexpr const char* TRACE_FILE = "/trace.bin";
+
+    TrafficTrace();
+    void begin(DebugOutput& logger);
+
+    bool startCapture(Sink sink);
+    void stopCapture();
+    bool isCapturing() const { return sink != SINK_NONE; }
+    void service();   // writes buffered records to the sink, call from loop()
+
+    void recordI2cCommand(char cmd, int index, int subIndex, uint32_t waitUs);
+    void recordI2cReply(int completionCode, uint32_t durationUs);
+    void recordHttp(int ipOctet, int cmd, HttpOrigin origin, int httpCode, uint32_t durationUs, const char* body, size_t length);
+
+    // Replay reads the trace file sequentially, timed replay reproduces the recorded HTTP latency
+    bool startReplay(bool timed);
+    void stopReplay();
+    bool isReplaying() const { return replaying; }
+    bool nextRecord(RecordHeader& header);   // the record data must then be read or skipped
+    void skipData(const RecordHeader& header);
+    int replayHttp(int ipOctet, int cmd, char* buffer, size_t size, char** body);
+    // The serial sink writes the trace as "trace|" lines of hex between the log output, the host
+    // concatenates the decoded lines into a trace file. Decoding returns the number of bytes, 0 for
+    // a line of log output
+    static void encodeSerialLine(const uint8_t* data, size_t length, Print& output);
+    static size_t decodeSerialLine(const char* line, uint8_t* data, size_t size);
+
+    uint32_t getReplayMismatches() const { return replayMismatches; }
+    uint32_t getReplayBackground() const { return replayBackground; }
+    void countMismatch() { replayMismatches++; }
+    // skips a background TRACE_HTTP record and returns true, false for any other record
+    bool skipBackground(const RecordHeader& header);
+
+private:
+    static constexpr size_t RING_SIZE = 4096;
+    uint8_t ring[RING_SIZE];
+    size_t ringHead;    // next byte written
+    size_t ringTail;    // next byte flushed
+    uint32_t dropped;   // records lost because the ring was full
+    portMUX_TYPE lock;
+
+    Sink sink;
+    File traceFile;
+    DebugOutput log;
+
+    bool replaying;
+    bool replayTimed;
+    bool havePending;
+    RecordHeader pending;   // header read ahead that was not consumed
+    uint32_t replayMismatches;
+    uint32_t replayBackground;   // background requests skipped
+
+    void append(const RecordHeader& header, const char* data);
+    void writeToSink(const uint8_t* data, size_t length);
+};
+
+#endif // TRAFFICTRACE_H
@@ -2,6 +2,12 @@
 #include <Wire.h>
 #include "TasmotaPlugs.h"
 #include "DebugOutput.h"
+#include "TrafficTrace.h"
+#include "EventQueue.h"
+#include "Telemetry.h"
+#include "EnergyAggregator.h"
+#include "LoadShedder.h"
+#include "GatewayCommands.h"
 
 
 constexpr int8_t PRIMARY_I2C_ADDR = 0X35;
@@ -15,7 +21,7 @@ enum State {
     PayloadReady,  // State when ready to send detailed payload data
 };
 
-class I2cInterface {
+class I2cInterface : public GatewayCodes {
 private:
     static I2cInterface* instance;  // Static instance pointer
 
@@ -26,6 +32,18 @@ private:
     static volatile State currentState;
     static int8_t lastCompletionCode;
     static EnergyValues lastValues;
+    static EventQueue* eventPtr;
+    static Telemetry* telemetryPtr;
+    static EnergyAggregator* aggregatorPtr;
+    static LoadShedder* shedderPtr;
+    static uint8_t payload[32];          // data sent after a successful completion code, sized for AVR masters
+    static uint8_t payloadLength;
+    static volatile int8_t gatewayStatus;
+    static TrafficTrace* tracePtr;
+    static volatile uint32_t commandReceivedUs;
+    static volatile int8_t immediateCode;   // reply to an immediate command, sent ahead of any pending reply
+    static volatile bool immediatePending;
+    static volatile bool replaying;          // commands from the master are refused while a trace is replayed
 
 public:
     I2cInterface() {
@@ -36,20 +54,6 @@ public:
         instance = nullptr;  // Clear the instance pointer
     }
 
-    // API Return codes 
-    static constexpr int8_t RET_SUCCESS = 0;
-    static constexpr int8_t ERR_URL_PREPARATION_FAILED = -1;
-    static constexpr int8_t ERR_HTTP_REQUEST_FAILED = -2;
-    static constexpr int8_t ERR_UNHANDLED_CASE = -3;
-    static constexpr int8_t ERR_JSON_ERROR = -101;
-    static constexpr int8_t ERR_UNKNOWN_STATE = -102;
-    static constexpr int8_t ERR_PLUG_NOT_CONNECTED = -103;
-    static constexpr int8_t ERR_TASMOTA_REQUEST_FAILED = -104;
-    static constexpr int8_t ERR_PLUG_REF_INVALID = -105;
-    static constexpr int8_t ERR_I2C_TIMEOUT = -106;
-    static constexpr int8_t ERR_UNKNOWN_COMMAND = -107;
-    static constexpr int8_t ERR_BUSY = -108;
-
     static void begin(byte address, TasmotaPlugs& plugs, DebugOutput& logger) {
         deviceAddress = address;
         plugPtr = &plugs;
@@ -61,84 +65,356 @@ public:
         currentState = ReadyForCmd;
     }
 
+    static void setGatewayStatus(int8_t status) {
+        gatewayStatus = status;
+    }
+
+    static int8_t getGatewayStatus() {
+        return gatewayStatus;
+    }
+
+    static void setTrace(TrafficTrace* trace) {
+        tracePtr = trace;
+    }
+
+    static void setEventQueue(EventQueue* events) {
+        eventPtr = events;
+    }
+
+    static void setTelemetry(Telemetry* telemetry) {
+        telemetryPtr = telemetry;
+    }
+
+    static void setAggregator(EnergyAggregator* aggregator) {
+        aggregatorPtr = aggregator;
+    }
+
+    static void setLoadShedder(LoadShedder* shedder) {
+        shedderPtr = shedder;
+    }
+
+    // true when no command from the master is waiting for service, background polls only run then
+    static bool isIdle() {
+        return currentState != ReadyForService;
+    }
+
+    static constexpr int MAX_EVENTS_PER_READ = sizeof(payload) / sizeof(GatewayEvent);
+
     static void receiveEvent(int howMany) {
         if (Wire.available() == 3) {
-            commandBuffer[0] = Wire.read();
-            logPtr->debug("got cmd %c\n", commandBuffer[0]);
-            if(validateCommand(commandBuffer[0])) {
+            byte cmd = Wire.read();
+            logPtr->debug("got cmd %c\n", cmd);
+            if(validateCommand(cmd)) {
+                byte index = Wire.read();
+                byte subIndex = Wire.read();
+                if (isImmediate(cmd)) {
+                    // answered from its own slot, so a command in progress or an unread reply is not disturbed
+                    immediateCode = dispatch(cmd, index, subIndex);
+                    immediatePending = true;
+                    return;
+                }
+                if (replaying) {
+                    // the replay owns the command state, the master is told to retry
+                    immediateCode = ERR_BUSY;
+                    immediatePending = true;
+                    return;
+                }
                 // only fill command buffer and change state if command is  valid
-                for (int i = 1; i < 3; i++) {
-                    commandBuffer[i] = Wire.read();
+                commandReceivedUs = micros();
+                commandBuffer[0] = cmd;
+                commandBuffer[1] = index;
+                commandBuffer[2] = subIndex;
+                if (gatewayStatus != STATUS_READY) {
+                    lastCompletionCode = ERR_NOT_READY;
+                    currentState = ReadyForReply;
+                } else {
+                    currentState = ReadyForService;
                 }
-                currentState = ReadyForService;
             }
         }
     }
 
     static bool validateCommand(byte cmd) {
-       switch (cmd) {
-            case 'H': 
-            case 'L': 
-            case 'R': 
-            case 'E':
-                return true;
-            defualt: 
-                return false;    
-            }
-        return false;    
+        return isValidCommand(cmd);
     }
     
     static void requestEvent() {
-        logPtr->debug("requestEvent in state: %d\n", currentState);   
-        switch (currentState) {
+        uint8_t reply[sizeof(payload)];
+        if (immediatePending) {
+            immediatePending = false;
+            reply[0] = immediateCode;
+            Wire.write(reply, 1);
+            return;
+        }
+        if (replaying) {
+            reply[0] = ERR_BUSY;
+            Wire.write(reply, 1);
+            return;
+        }
+        State state = currentState;
+        size_t length = encodeReply(state, lastCompletionCode, payload, payloadLength, reply);
+        currentState = state;
+        Wire.write(reply, length);
+    }
+
+    // Fills reply with the bytes for the master's read request and advances state to the next reply
+    static size_t encodeReply(State& state, int8_t code, const uint8_t* data, uint8_t length, uint8_t* reply) {
+        logPtr->debug("requestEvent in state: %d\n", state);   
+        switch (state) {
             case ReadyForService:
                 logPtr->debug("event requested in state: ReadyForService\n");
-                Wire.write(ERR_BUSY);
-                break; 
+                reply[0] = ERR_BUSY;
+                return 1;
             case ReadyForReply:
-                logPtr->debug("Completion Code: %d\n", lastCompletionCode);           
-                Wire.write(lastCompletionCode);
-                if (commandBuffer[0] == 'E' && lastCompletionCode == RET_SUCCESS) {
-                    currentState = PayloadReady;  // Transition to payload ready state
+                logPtr->debug("Completion Code: %d\n", code);           
+                reply[0] = code;
+                if (length > 0 && code >= RET_SUCCESS) {
+                    state = PayloadReady;  // Transition to payload ready state
                 } else {
-                    currentState = ReadyForCmd;  // Reset to idle after sending response
+                    state = ReadyForCmd;  // Reset to idle after sending response
                 }
-                break;
+                return 1;
             case PayloadReady:
-                Wire.write(reinterpret_cast<const uint8_t*>(&lastValues), sizeof(lastValues));
-                currentState = ReadyForCmd;  // Return to idle after sending the payload
-                break;
+                memcpy(reply, data, length);
+                state = ReadyForCmd;  // Return to idle after sending the payload
+                return length;
             default:
-                logPtr->error("unknown state in requstEvent: %d\n", currentState);
-                Wire.write(ERR_UNKNOWN_STATE);  // Handle unexpected state by reporting an error
-                break;
+                logPtr->error("unknown state in requstEvent: %d\n", state);
+                reply[0] = ERR_UNKNOWN_STATE;  // Handle unexpected state by reporting an error
+                return 1;
              }
     }
+
+    // Benchmark body: encodes the completion code and energy payload of an 'E' reply.
+    // Works on its own copy of the reply state so a command or reply in progress is not disturbed
+    static void benchmarkReplyEncoding(void* context) {
+        uint8_t reply[sizeof(payload)];
+        uint8_t data[sizeof(EnergyValues)];
+        memcpy(data, &lastValues, sizeof(lastValues));
+        State state = ReadyForReply;
+        encodeReply(state, RET_SUCCESS, data, sizeof(data), reply);
+        encodeReply(state, RET_SUCCESS, data, sizeof(data), reply);
+    }
  
      void service() {
         if (currentState == ReadyForService) {
             char cmd = commandBuffer[0];
             int index = commandBuffer[1];
             int subIndex = commandBuffer[2];
+            if (tracePtr != nullptr) {
+                tracePtr->recordI2cCommand(cmd, index, subIndex, micros() - commandReceivedUs);
+            }
+            uint32_t startUs = micros();
             handleCmd(cmd, index, subIndex);
+            if (tracePtr != nullptr) {
+                tracePtr->recordI2cReply(lastCompletionCode, micros() - startUs);
+            }
         }
     }
 
+    // Runs the commands in the captured trace through handleCmd, with plug replies served from the trace.
+    // Reports handling time per command and the number of replies that differ from the recording.
+    // The gateway state the replayed commands change is saved first and put back afterwards, so a
+    // command or reply the master has not yet collected, the relay states, the event queue,
+    // telemetry, aggregates and load shedding are as they were before the replay
+    static void replay(TrafficTrace& trace, bool timed, Stream& outputStream) {
+        if (!trace.startReplay(timed)) {
+            return;
+        }
+        replaying = true;
+        State savedState = currentState;
+        byte savedCommand[sizeof(commandBuffer)];
+        memcpy(savedCommand, commandBuffer, sizeof(commandBuffer));
+        int8_t savedCompletionCode = lastCompletionCode;
+        uint8_t savedPayload[sizeof(payload)];
+        memcpy(savedPayload, payload, sizeof(payload));
+        uint8_t savedPayloadLength = payloadLength;
+        EnergyValues savedValues = lastValues;
+        std::vector<int> savedPlugStates;
+        for (const auto& ipPlugs : plugPtr->plugs) {
+            for (const auto& plug : ipPlugs) {
+                savedPlugStates.push_back(plug.plugState);
+            }
+        }
+        EventQueue* savedEvents = eventPtr;
+        Telemetry* savedTelemetry = telemetryPtr;
+        EnergyAggregator* savedAggregator = aggregatorPtr;
+        LoadShedder* savedShedder = shedderPtr;
+        EventQueue replayEvents;   // replayed 'V' commands read from an empty queue
+        eventPtr = &replayEvents;
+        telemetryPtr = nullptr;
+        aggregatorPtr = nullptr;
+        shedderPtr = nullptr;
+
+        uint32_t commands = 0;
+        uint32_t codeMismatches = 0;
+        uint32_t totalUs = 0;
+        uint32_t maxUs = 0;
+        uint32_t recordedUs = 0;
+        TrafficTrace::RecordHeader header;
+        bool haveCommand = false;
+        while (trace.nextRecord(header)) {
+            if (trace.skipBackground(header)) {
+                continue;   // a poll, shed or pin switch, no replayed command makes it
+            }
+            trace.skipData(header);
+            if (header.type == TrafficTrace::TRACE_I2C_COMMAND) {
+                uint32_t startUs = micros();
+                handleCmd((char)header.args[0], header.args[1], header.args[2]);
+                uint32_t elapsedUs = micros() - startUs;
+                totalUs += elapsedUs;
+                maxUs = elapsedUs > maxUs ? elapsedUs : maxUs;
+                commands++;
+                haveCommand = true;
+            } else if (header.type == TrafficTrace::TRACE_I2C_REPLY && haveCommand) {
+                recordedUs += header.durationUs;
+                if (header.result != lastCompletionCode) {
+                    codeMismatches++;
+                }
+                haveCommand = false;
+            } else if (header.type == TrafficTrace::TRACE_HTTP) {
+                trace.countMismatch();  // a recorded command request this firmware did not make
+            }
+        }
+        uint32_t requestMismatches = trace.getReplayMismatches();
+        uint32_t background = trace.getReplayBackground();
+        trace.stopReplay();
+
+        eventPtr = savedEvents;
+        telemetryPtr = savedTelemetry;
+        aggregatorPtr = savedAggregator;
+        shedderPtr = savedShedder;
+        size_t plugIndex = 0;
+        for (auto& ipPlugs : plugPtr->plugs) {
+            for (auto& plug : ipPlugs) {
+                plug.plugState = savedPlugStates[plugIndex++];
+            }
+        }
+        lastValues = savedValues;
+        payloadLength = savedPayloadLength;
+        memcpy(payload, savedPayload, sizeof(payload));
+        lastCompletionCode = savedCompletionCode;
+        memcpy(commandBuffer, savedCommand, sizeof(commandBuffer));
+        currentState = savedState;
+        replaying = false;
+        outputStream.printf("replay|commands=%lu,totalUs=%lu,meanUs=%lu,maxUs=%lu,recordedUs=%lu,codeMismatches=%lu,requestMismatches=%lu,"
+                            "backgroundRequests=%lu\n",
+                            (unsigned long)commands, (unsigned long)totalUs,
+                            (unsigned long)(commands ? totalUs / commands : 0), (unsigned long)maxUs,
+                            (unsigned long)recordedUs, (unsigned long)codeMismatches, (unsigned long)requestMismatches,
+                            (unsigned long)background);
+    }
+
     static void handleCmd(char cmd, int index, int subIndex) {
+        if (!isValidCommand(cmd)) {
+            logPtr->error("ERROR, unexpected command: %c\n", cmd);
+            lastCompletionCode = ERR_UNKNOWN_COMMAND;
+            currentState = ReadyForCmd; 
+            return;   
+        }
+        payloadLength = 0;
+        TasmotaPlugs::OriginScope scope(*plugPtr, TrafficTrace::HTTP_COMMAND);
+        lastCompletionCode = dispatch(cmd, index, subIndex);
+        currentState = ReadyForReply; 
+    }
+
+    // Runs the handler for cmd and returns its completion code
+    static int8_t dispatch(char cmd, int index, int subIndex) {
+#define I2C_DISPATCH(code, name, size, immediate) case code: return handle##name(index, subIndex);
         switch (cmd) {
-            case 'H': lastCompletionCode = plugPtr->setPlugState(index, subIndex, true); break;
-            case 'L': lastCompletionCode = plugPtr->setPlugState(index, subIndex, false); break;
-            case 'R': lastCompletionCode = plugPtr->getRSSI(index, subIndex); break;
-            case 'E': lastCompletionCode = plugPtr->getEnergyValues(index, subIndex, lastValues); break;
+            GATEWAY_I2C_COMMANDS(I2C_DISPATCH)
             default:
-                logPtr->error("ERROR, unexpected command: %c\n, cmd");
-                lastCompletionCode = ERR_UNKNOWN_COMMAND;
-                currentState = ReadyForCmd; 
-                return;   
+                return ERR_UNKNOWN_COMMAND;
+        }
+#undef I2C_DISPATCH
+    }
+
+    // One handler per entry in GATEWAY_I2C_COMMANDS, each returns the completion code and sets any payload.
+    // Immediate commands run in the receive handler and must not touch the payload
+    static int8_t handlePowerOn(int index, int subIndex) {
+        releaseShed(index);
+        return plugPtr->setPlugState(index, subIndex, true);
+    }
+
+    static int8_t handlePowerOff(int index, int subIndex) {
+        releaseShed(index);
+        return plugPtr->setPlugState(index, subIndex, false);
+    }
+
+    // the master's choice overrides load shedding, the plug is not restored by the shedder
+    static void releaseShed(int index) {
+        if (shedderPtr != nullptr) {
+            shedderPtr->release(index);
         }
-        currentState = ReadyForReply; 
     }
 
+    static int8_t handleRSSI(int index, int subIndex) {
+        return plugPtr->getRSSI(index, subIndex);
+    }
+
+    static int8_t handleEnergy(int index, int subIndex) {
+        int8_t result = plugPtr->getEnergyValues(index, subIndex, lastValues);
+        if (telemetryPtr != nullptr) {
+            // the master is watching this plug, so poll it more often and keep this reading
+            telemetryPtr->noteInterest(index);
+            if (result == RET_SUCCESS) {
+                telemetryPtr->addSample(index, lastValues);
+            }
+        }
+        memcpy(payload, &lastValues, sizeof(lastValues));
+        payloadLength = sizeof(lastValues);
+        return result;
+    }
+
+    // answered from the receive handler so it is available while the gateway is starting
+    static int8_t handleStatus(int index, int subIndex) {
+        return gatewayStatus;
+    }
+
+    static int8_t handleEvents(int index, int subIndex) {
+        // completion code is the number of events that follow in the payload
+        int count = 0;
+        if (eventPtr != nullptr) {
+            count = eventPtr->pop(reinterpret_cast<GatewayEvent*>(payload), MAX_EVENTS_PER_READ);
+        }
+        payloadLength = count * sizeof(GatewayEvent);
+        return count;
+    }
+
+    static int8_t handleShardInfo(int index, int subIndex) {
+        // global plug ids of this gateway when two gateways share a fleet
+        payload[0] = plugPtr->config.first_plug_id;
+        payload[1] = plugPtr->plugs.size();
+        payloadLength = 2;
+        return RET_SUCCESS;
+    }
+
+    static int8_t handleAggregate(int index, int subIndex) {
+        // index is the IP index or FLEET_INDEX, subIndex is the AggregateWindow
+        AggregateValues values = {};
+        int8_t result = ERR_UNKNOWN_COMMAND;
+        if (aggregatorPtr != nullptr) {
+            result = aggregatorPtr->getAggregate(index, (AggregateWindow)subIndex, values);
+        }
+        if (telemetryPtr != nullptr) {
+            telemetryPtr->noteInterest(index);
+        }
+        memcpy(payload, &values, sizeof(values));
+        payloadLength = sizeof(values);
+        return result;
+    }
+
+    // The reply sizes in the command table are what the client reads, keep them in step with the payloads
+#define I2C_REPLY_FITS(code, name, size, immediate) \
+    static_assert(size <= sizeof(payload), "reply for " #name " does not fit the I2C payload"); \
+    static_assert(!immediate || size == 0, "immediate command " #name " cannot send a payload");
+    GATEWAY_I2C_COMMANDS(I2C_REPLY_FITS)
+#undef I2C_REPLY_FITS
+    static_assert(replySize(I2C_CMD_Energy) == sizeof(EnergyValues), "Energy reply size does not match EnergyValues");
+    static_assert(replySize(I2C_CMD_Aggregate) == sizeof(AggregateValues), "Aggregate reply size does not match AggregateValues");
+    static_assert(replySize(I2C_CMD_Events) == MAX_EVENTS_PER_READ * sizeof(GatewayEvent), "Events reply size does not match MAX_EVENTS_PER_READ");
+    static_assert(replySize(I2C_CMD_ShardInfo) == 2, "ShardInfo reply is the first plug id and the plug count");
+
 };
 
 // Initialize the static member
@@ -149,4 +425,16 @@ byte I2cInterface::deviceAddress = PRIMARY_I2C_ADDR;  // Default value initializ
 byte I2cInterface::commandBuffer[3] = {0};
 volatile State I2cInterface::currentState = ReadyForCmd;  
 int8_t I2cInterface::lastCompletionCode = ERR_UNKNOWN_STATE;
-EnergyValues I2cInterface::lastValues = {};
\ No newline at end of file
+EnergyValues I2cInterface::lastValues = {};
+EventQueue* I2cInterface::eventPtr = nullptr;
+Telemetry* I2cInterface::telemetryPtr = nullptr;
+EnergyAggregator* I2cInterface::aggregatorPtr = nullptr;
+LoadShedder* I2cInterface::shedderPtr = nullptr;
+uint8_t I2cInterface::payload[32] = {0};
+uint8_t I2cInterface::payloadLength = 0;
+volatile int8_t I2cInterface::gatewayStatus = I2cInterface::STATUS_STARTING;
+TrafficTrace* I2cInterface::tracePtr = nullptr;
+volatile uint32_t I2cInterface::commandReceivedUs = 0;
+volatile int8_t I2cInterface::immediateCode = 0;
+volatile bool I2cInterface::immediatePending = false;
+volatile bool I2cInterface::replaying = false;
\ No newline at end of file
@@ -18,16 +18,40 @@
 #include "DebugOutput.h"
 #include "TasmotaPlugs.h"
 #include "i2cInterface.h"
+#include "BootTimer.h"
+#include "TrafficTrace.h"
+#include "Telemetry.h"
+#include "LoadShedder.h"
+#include "EventQueue.h"
+#include "PlugMonitor.h"
+#include "EnergyAggregator.h"
+#include "Benchmark.h"
+#include "SoakTest.h"
 
 
 //#define  SPOOF_MAC "3341"  // if defined, overrides hardware MAC for testing fixed SSID 
+//#define FAST_START  // if defined, skips startup delays and brings up the access point while config loads
 
 static const int PRIMARY_I2C_ADDR_PIN = 21;    // jumper this pin low to use primary I2C address
 static const int SECONDARY_I2C_ADDR_PIN  = 5;  // or jumper this pin low to use secondary I2C address
                                                // or if nether is low, use Pin Control
 
+static const uint32_t RECONCILE_TIMEOUT_MS = 10000; // time allowed for plugs to report their state at startup
+static const uint32_t TELEMETRY_MAX_INTERVAL_MS = 30000;  // longest time between energy readings of an idle plug
+static const uint32_t SHED_MAX_INTERVAL_MS = 5000;        // longest time between readings when load shedding
+static const uint32_t MONITOR_PERIOD_MS = 5000;      // time to check every plug once for external changes
+static const unsigned int SERIAL_LINE_MAX = 1200;    // longest serial command kept, a config| line included
+
 const int  VERBOSITY_LEVEL = 1; // -1 = no output, 0 = errors only,  1 = errors and info, 2 = errors, info and debug
 DebugOutput logger;
+BootTimer bootTimer;
+TrafficTrace trafficTrace;
+Telemetry telemetry;
+LoadShedder loadShedder;
+EventQueue eventQueue;
+PlugMonitor plugMonitor;
+EnergyAggregator energyAggregator;
+SoakTest soakTest;
 
 TasmotaPlugs tasmotaPlugs;
 I2cInterface i2cInterface;
@@ -65,25 +89,35 @@ int setupWiFi() {
 }
 
 void checkPinState(int ipIndex) {
+    if (tasmotaPlugs.plugs[ipIndex].empty()) {
+        return;
+    }
     PlugState& plug = tasmotaPlugs.plugs[ipIndex][0];  // Pin mode assumes a single subindex
     if (plug.pin >= 0) {
         int currentPinState = digitalRead(plug.pin);
 
         // Check if the read state from the hardware pin differs from the stored state
         if (currentPinState != plug.pinState) {
-            //logger.debug("Getting state of plug  at %s controlled by pin %d\n", tasmotaPlugs.getIPAddress(plug).c_str(), plug.pin);
-            int currentPlugState = tasmotaPlugs.getPlugState(ipIndex, 0);
+            //logger.debug("Getting state of plug  at %s controlled by pin %d\n", tasmotaPlugs.getIPAddress(plug), plug.pin);
+            int currentPlugState;
+            if (plug.pinState == -1 && plug.plugState >= 0) {
+                // first check after startup, use the state found by reconcilePlugStates
+                currentPlugState = plug.plugState;
+            } else {
+                currentPlugState = tasmotaPlugs.getPlugState(ipIndex, 0);
+            }
             //logger.debug("Current state of plug on pin %d is %d\n", plug.pin, currentPlugState);
 
             // Check if the state fetch was successful
             if (currentPlugState >= 0) {
-                logger.debug("plug  at %s has state %d, pin %d has state %d\n", tasmotaPlugs.getIPAddress(plug).c_str(),
+                logger.debug("plug  at %s has state %d, pin %d has state %d\n", tasmotaPlugs.getIPAddress(plug),
                           currentPlugState, plug.pin, currentPinState);
                 // Determine if there's a mismatch between the physical pin state and the logical state
                 if ((currentPinState == HIGH && currentPlugState != 1) ||
                     (currentPinState == LOW && currentPlugState != 0)) {
 
-                    // change plug state to match logical state
+                    // change plug state to match logical state, the pin overrides load shedding
+                    loadShedder.release(ipIndex);
                     if (currentPinState == HIGH) {
                         logger.info("Pin %d went HIGH, Sending 'Power On' command.\n", plug.pin);
                         tasmotaPlugs.setPlugState(ipIndex, 0, true);  // Corrected to use updated method signature
@@ -97,7 +131,7 @@ void checkPinState(int ipIndex) {
             } else {
                 // log errors in fetching the current plug state
                 logger.info("Error getting status for plug at %s: %s\n", 
-                    tasmotaPlugs.getIPAddress(plug).c_str(), tasmotaPlugs.getErrorString(currentPlugState));
+                    tasmotaPlugs.getIPAddress(plug), tasmotaPlugs.getErrorString(currentPlugState));
             }
         }
     } else {
@@ -106,18 +140,113 @@ void checkPinState(int ipIndex) {
     }
 }
 
+// a plug switched at the plug itself is no longer held off or restored by load shedding
+void onExternalRelayChange(int ipIndex) {
+    loadShedder.release(ipIndex);
+}
+
 void processConfigUpdate(String newConfig){
     logger.info("new config is [%s]\n", newConfig.c_str());
 }
 
+// Every fresh reading, from a background poll or from an Energy command of the master, is
+// aggregated and checked against the power budget
+void onTelemetrySample(int ipIndex) {
+    PlugSample& sample = telemetry.sample(ipIndex);
+    energyAggregator.addSample(ipIndex, sample.values.Power, telemetry.totalPower(), sample.timeMs);
+    loadShedder.onSample(ipIndex);
+}
+
+// prints the latest telemetry reading of a plug and marks it as of interest
+void printEnergy(int ipIndex) {
+    if (ipIndex < 0 || (size_t)ipIndex >= telemetry.size()) {
+        Serial.printf("energy|index=%d,error=%d\n", ipIndex, TasmotaPlugs::ERR_PLUG_REF_INVALID);
+        return;
+    }
+    telemetry.noteInterest(ipIndex);
+    PlugSample& sample = telemetry.sample(ipIndex);
+    long staleness = sample.timeMs != 0 ? (long)(millis() - sample.timeMs) : -1;
+    Serial.printf("energy|index=%d,voltage=%.1f,current=%.3f,power=%.1f,today=%.3f,total=%.3f,stalenessMs=%ld\n",
+                  ipIndex, sample.values.Voltage, sample.values.Current, sample.values.Power,
+                  sample.values.Today, sample.values.Total, staleness);
+}
+
+// Collects the characters received so far and returns true once a whole line is in line.
+// readStringUntil would block the loop for the serial timeout when only part of a line has arrived
+bool readSerialLine(String& line) {
+    static String pending;
+    while (Serial.available()) {
+        char c = (char)Serial.read();
+        if (c == '\n') {
+            line = pending;
+            pending = "";
+            return true;
+        }
+        if (pending.length() < SERIAL_LINE_MAX) {
+            pending += c;
+        }
+    }
+    return false;
+}
+
+// Serial commands are checked on every loop pass, without waiting for a partial line
 void checkSerialEvents() {
-    if (Serial.available()) {
-        String incomingData = Serial.readStringUntil('\n'); // Read data until newline
+    String incomingData;
+    if (readSerialLine(incomingData)) {
         incomingData.trim(); // Trim any whitespace
 
         if (incomingData.indexOf("Probe") != -1) {
             tasmotaPlugs.config.writeConfigToStream(_ssid, Serial);
         }
+        else if (incomingData.indexOf("Status") != -1) {
+            Serial.printf("status|%d\n", I2cInterface::getGatewayStatus());
+        }
+        else if (incomingData.indexOf("Boot") != -1) {
+            bootTimer.report(logger);
+        }
+        else if (incomingData.indexOf("Heap") != -1) {
+            tasmotaPlugs.printHeapStats(Serial);
+        }
+        else if (incomingData.indexOf("Soak") != -1) {
+            String count = incomingData.substring(incomingData.indexOf("Soak") + 4);
+            count.trim();
+            soakTest.start(count.length() > 0 ? count.toInt() : SoakTest::DEFAULT_REQUESTS);
+        }
+        else if (incomingData.indexOf("Events") != -1) {
+            eventQueue.printEvents(Serial);
+        }
+        else if (incomingData.indexOf("Bench") != -1) {
+            Benchmark benchmark(Serial);
+            benchmark.runPlugBenchmarks(tasmotaPlugs);
+            benchmark.run("i2c_encode_energy_reply", I2cInterface::benchmarkReplyEncoding, nullptr);
+        }
+        else if (incomingData.indexOf("Agg") != -1) {
+            energyAggregator.printAggregates(Serial);
+        }
+        else if (incomingData.indexOf("Sched") != -1) {
+            telemetry.printSchedule(Serial);
+        }
+        else if (incomingData.indexOf("Energy") != -1) {
+            printEnergy(incomingData.substring(incomingData.indexOf("Energy") + 6).toInt());
+        }
+        else if (incomingData.indexOf("Shed") != -1) {
+            loadShedder.printStatus(Serial);
+        }
+        else if (incomingData.indexOf("TraceFile") != -1) {
+            trafficTrace.startCapture(TrafficTrace::SINK_FILE);
+        }
+        else if (incomingData.indexOf("TraceSerial") != -1) {
+            trafficTrace.startCapture(TrafficTrace::SINK_SERIAL);
+        }
+        else if (incomingData.indexOf("TraceStop") != -1) {
+            trafficTrace.stopCapture();
+        }
+        else if (incomingData.indexOf("ReplayTimed") != -1) {
+            I2cInterface::replay(trafficTrace, true, Serial);
+        }
+        else if (incomingData.indexOf("Replay") != -1) {
+            I2cInterface::replay(trafficTrace, false, Serial);
+        }
         else if(incomingData.indexOf("config|") != -1) {
             processConfigUpdate(incomingData.substring(incomingData.indexOf("config|")));
         }
@@ -125,28 +254,32 @@ void checkSerialEvents() {
 }
 
 
+#if defined FAST_START
+static SemaphoreHandle_t accessPointReady = nullptr;
+static unsigned long accessPointUpAt = 0;
+
+void startAccessPoint() {
+    while (setupWiFi() != TasmotaPlugs::RET_SUCCESS) {
+        logger.info("Retrying WiFi startup sequence\n");
+    }
+    accessPointUpAt = millis();
+}
+
+// brings up the access point while setup() loads the configuration
+void accessPointTask(void* param) {
+    startAccessPoint();
+    xSemaphoreGive(accessPointReady);
+    vTaskDelete(nullptr);
+}
+#endif
+
 void setup() {
    
     logger.begin(VERBOSITY_LEVEL);
     if(VERBOSITY_LEVEL >= 0)
       Serial.begin(115200);
 
-    delay(2000);
-    logger.info("Starting\n");
-
-    while (setupWiFi() != TasmotaPlugs::RET_SUCCESS) {
-        logger.info("Retrying WiFi startup sequence\n");
-    }
-    String ipString = WiFi.softAPIP().toString();
-    logger.info("Access Point started, IP Address: %s\n", ipString.c_str());
-
-    if (!LittleFS.begin()) {
-        logger.info("An Error has occurred while mounting LittleFS\n");
-    }
-    delay(1000);
-    tasmotaPlugs.begin(logger);
-    tasmotaPlugs.config.printConfig();
-    
+    // start the I2C slave first so the master sees STATUS_STARTING rather than no answer
     pinMode(PRIMARY_I2C_ADDR_PIN , INPUT_PULLUP);
     pinMode(SECONDARY_I2C_ADDR_PIN, INPUT_PULLUP);
 
@@ -157,17 +290,103 @@ void setup() {
         i2cInterface.begin(SECONDARY_I2C_ADDR, tasmotaPlugs, logger); 
     }
     else {
+        pinControl = true;
+    }
+    bootTimer.mark("i2c");
+
+#if defined FAST_START
+    logger.info("Starting (fast start)\n");
+    accessPointReady = xSemaphoreCreateBinary();
+    bool accessPointStarting = accessPointReady != nullptr &&
+                               xTaskCreate(accessPointTask, "accessPoint", 4096, nullptr, 1, nullptr) == pdPASS;
+    if (!accessPointStarting) {
+        logger.error("Unable to start access point task, starting access point before loading config\n");
+        startAccessPoint();
+    }
+#else
+    delay(2000);  // allow time to open the serial monitor
+    bootTimer.mark("serial wait");
+    logger.info("Starting\n");
+
+    while (setupWiFi() != TasmotaPlugs::RET_SUCCESS) {
+        logger.info("Retrying WiFi startup sequence\n");
+    }
+    bootTimer.mark("access point");
+    delay(1000);
+#endif
+
+    trafficTrace.begin(logger);
+    tasmotaPlugs.setTrace(&trafficTrace);
+    I2cInterface::setTrace(&trafficTrace);
+    tasmotaPlugs.begin(logger);  // mounts LittleFS and loads config.json
+    tasmotaPlugs.config.printConfig();
+    telemetry.begin(tasmotaPlugs, logger, TELEMETRY_MAX_INTERVAL_MS);
+    loadShedder.begin(tasmotaPlugs, telemetry, logger);
+    if (loadShedder.enabled()) {
+        telemetry.setMaxInterval(SHED_MAX_INTERVAL_MS);
+    }
+    I2cInterface::setTelemetry(&telemetry);
+    energyAggregator.begin(tasmotaPlugs.plugs.size(), logger);
+    telemetry.setListener(onTelemetrySample);
+    I2cInterface::setAggregator(&energyAggregator);
+    I2cInterface::setLoadShedder(&loadShedder);
+    plugMonitor.begin(tasmotaPlugs, eventQueue, logger, MONITOR_PERIOD_MS);
+    plugMonitor.setListener(onExternalRelayChange);
+    I2cInterface::setEventQueue(&eventQueue);
+    soakTest.begin(tasmotaPlugs, Serial);
+    bootTimer.mark("config");
+
+    if (pinControl) {
        // neither I2C jumper is enabled 
        logger.info("Pin control is enabled)\n");
-       pinControl = true;
        size_t nbrPins = tasmotaPlugs.config.esp_pin_map.size();
        for(size_t i = 0; i <  nbrPins; i++){
             int pin = tasmotaPlugs.config.esp_pin_map[i];
             pinMode(pin, INPUT_PULLDOWN);
             logger.debug("Setting ESP pin %d to INPUT_PULLDOWN\n", pin);
        }
+       bootTimer.mark("pins");
+    }
+
+#if defined FAST_START
+    if (accessPointStarting) {
+        xSemaphoreTake(accessPointReady, portMAX_DELAY);
     }
+    bootTimer.mark("access point");
+    logger.info("Access point was up %lu ms after reset\n", accessPointUpAt);
+#endif
+    String ipString = WiFi.softAPIP().toString();
+    logger.info("Access Point started, IP Address: %s\n", ipString.c_str());
+
+    // learn the relay state of every plug before reporting ready
+    I2cInterface::setGatewayStatus(I2cInterface::STATUS_RECONCILING);
+    int answered = tasmotaPlugs.reconcilePlugStates(RECONCILE_TIMEOUT_MS);
+    bootTimer.mark("reconcile");
+    I2cInterface::setGatewayStatus(I2cInterface::STATUS_READY);
+    logger.info("Gateway ready, %d of %d plugs answered\n", answered, (int)tasmotaPlugs.plugs.size());
+    bootTimer.report(logger);
+#if !defined FAST_START
     delay(100);
+#endif
+}
+
+// Telemetry and the plug monitor share the request budget, whichever did not poll last has the first
+// claim on the next free slot. A poll blocks the loop until the plug answers, so none is started
+// while a command from the master is waiting
+void serviceBackgroundPolls() {
+    static bool telemetryNext = true;
+    for (int turn = 0; turn < 2 && I2cInterface::isIdle(); turn++) {
+        if (telemetryNext) {
+            if (telemetry.service() >= 0) {
+                telemetryNext = false;
+                return;
+            }
+        } else if (plugMonitor.service() >= 0) {
+            telemetryNext = true;
+            return;
+        }
+        telemetryNext = !telemetryNext;
+    }
 }
 
 static int prevNbrStations = -1;
@@ -190,8 +409,11 @@ void loop() {
        else{
            i2cInterface.service();
        }
+       soakTest.service();
+       serviceBackgroundPolls();
     }
-    // checkSerialEvents();
+    checkSerialEvents();
+    trafficTrace.service();
 
     delay(50);
 }
@@ -0,0 +1,123 @@
+#ifndef GATEWAYCOMMANDS_H
+#define GATEWAYCOMMANDS_H
+
+/*
+   Command and error tables shared by the gateway and the Arduino I2C client.
+   Validation, dispatch, reply sizes, Tasmota request strings, error strings and the
+   client command stubs are all generated from these lists. The tables do not link an
+   I2C command to the Tasmota commands it sends, so a new command that reaches a plug
+   needs an entry in each table, its handle<name> method in I2cInterface and a
+   TasmotaPlugs method that sends the request and parses the reply. The Tasmota
+   requests are fixed strings prepared for each plug at startup and an I2C command
+   carries only a plug index and sub index, so a command with a value such as
+   "Dimmer <value>" cannot be expressed.
+   The client sketch cannot include files outside its folder, so
+   test/I2cTest/GatewayCommands.h is a copy of this file and must be kept identical,
+   test_replies fails when they differ.
+*/
+
+#include <stdint.h>
+
+// I2C commands: X(code, name, replySize, immediate)
+//   replySize  - largest payload sent after a successful completion code, at most 32 bytes for AVR masters
+//   immediate  - answered in the receive handler, so available while the gateway is starting
+#define GATEWAY_I2C_COMMANDS(X)          \
+    X('H', PowerOn,   0,  false)         \
+    X('L', PowerOff,  0,  false)         \
+    X('R', RSSI,      0,  false)         \
+    X('E', Energy,    24, false)         \
+    X('S', Status,    0,  true)          \
+    X('V', Events,    32, false)         \
+    X('M', ShardInfo, 2,  false)         \
+    X('A', Aggregate, 16, false)
+
+// Tasmota commands sent to the plugs: X(id, URL encoded command)
+#define TASMOTA_COMMANDS(X)              \
+    X(CMD_POWER_QUERY, "Power")          \
+    X(CMD_POWER_ON,    "Power%20On")     \
+    X(CMD_POWER_OFF,   "Power%20Off")    \
+    X(CMD_STATUS_10,   "Status%2010")    \
+    X(CMD_STATUS_11,   "Status%2011")
+
+// Completion codes: X(name, value, description)
+#define GATEWAY_ERRORS(X)                                             \
+    X(RET_SUCCESS,                0,    "Success")                    \
+    X(ERR_URL_PREPARATION_FAILED, -1,   "URL preparation failed")     \
+    X(ERR_HTTP_REQUEST_FAILED,    -2,   "HTTP request failed")        \
+    X(ERR_UNHANDLED_CASE,         -3,   "Unhandled case")             \
+    X(ERR_I2C_RESPONSE_TIMEOUT,   -100, "No I2C response")            \
+    X(ERR_JSON_ERROR,             -101, "JSON parsing error")         \
+    X(ERR_UNKNOWN_STATE,          -102, "Unknown state")              \
+    X(ERR_PLUG_NOT_CONNECTED,     -103, "Plug not connected")         \
+    X(ERR_TASMOTA_REQUEST_FAILED, -104, "Tasmota request failed")     \
+    X(ERR_PLUG_REF_INVALID,       -105, "Invalid plug reference")     \
+    X(ERR_I2C_TIMEOUT,            -106, "I2C timeout")                \
+    X(ERR_UNKNOWN_COMMAND,        -107, "Unknown command")            \
+    X(ERR_BUSY,                   -108, "Gateway busy")               \
+    X(ERR_NOT_READY,              -109, "Gateway starting")
+
+// Gateway status returned by the 'S' command
+#define GATEWAY_STATUS(X)                                                                   \
+    X(STATUS_STARTING,    1)   /* booting, plug configuration not yet loaded */             \
+    X(STATUS_RECONCILING, 2)   /* querying plugs for their current relay state */           \
+    X(STATUS_READY,       3)   /* all plugs answered or timed out, commands accepted */
+
+#define GATEWAY_ENUM_COMMAND(code, name, replySize, immediate) I2C_CMD_##name = code,
+enum GatewayCommand : char {
+    GATEWAY_I2C_COMMANDS(GATEWAY_ENUM_COMMAND)
+};
+#undef GATEWAY_ENUM_COMMAND
+
+#define GATEWAY_ENUM_TASMOTA(id, command) id,
+enum PlugCommand {
+    TASMOTA_COMMANDS(GATEWAY_ENUM_TASMOTA)
+    PLUG_CMD_COUNT
+};
+#undef GATEWAY_ENUM_TASMOTA
+
+// Error codes and status values are members so classes that derive from this can use them unqualified
+struct GatewayCodes {
+#define GATEWAY_ENUM_ERROR(name, value, description) name = value,
+#define GATEWAY_ENUM_STATUS(name, value) name = value,
+    enum : int8_t {
+        GATEWAY_ERRORS(GATEWAY_ENUM_ERROR)
+        GATEWAY_STATUS(GATEWAY_ENUM_STATUS)
+    };
+#undef GATEWAY_ENUM_ERROR
+#undef GATEWAY_ENUM_STATUS
+
+    static const char* errorString(int errorCode) {
+#define GATEWAY_ERROR_CASE(name, value, description) case value: return description;
+        switch (errorCode) {
+            GATEWAY_ERRORS(GATEWAY_ERROR_CASE)
+            default: return "Unknown error";
+        }
+#undef GATEWAY_ERROR_CASE
+    }
+
+    static bool isValidCommand(char cmd) {
+#define GATEWAY_COMMAND_CASE(code, name, replySize, immediate) case code:
+        switch (cmd) {
+            GATEWAY_I2C_COMMANDS(GATEWAY_COMMAND_CASE)
+                return true;
+            default:
+                return false;
+        }
+#undef GATEWAY_COMMAND_CASE
+    }
+
+    // constexpr so the sizes can be checked at compile time against the payload structures
+    static constexpr uint8_t replySize(char cmd) {
+#define GATEWAY_REPLY_SIZE(code, name, size, immediate) cmd == code ? size :
+        return GATEWAY_I2C_COMMANDS(GATEWAY_REPLY_SIZE) 0;
+#undef GATEWAY_REPLY_SIZE
+    }
+
+    static constexpr bool isImmediate(char cmd) {
+#define GATEWAY_IMMEDIATE(code, name, size, immediate) cmd == code ? immediate :
+        return GATEWAY_I2C_COMMANDS(GATEWAY_IMMEDIATE) false;
+#undef GATEWAY_IMMEDIATE
+    }
+};
+
+#endif // GATEWAYCOMMANDS_H
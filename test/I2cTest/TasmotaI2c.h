@@ -1,9 +1,20 @@
 #include <Wire.h>
+#include "GatewayCommands.h"   // copy of src/GatewayCommands.h, keep both identical
 
 
 const int8_t PRIMARY_I2C_ADDR = 0X35;
 const int8_t SECONDARY_I2C_ADDR = 0X55;
-    
+
+// Completion codes, ERR_BUSY means the gateway is still handling the command
+#define CLIENT_ERROR_CONSTANT(name, value, description) const int8_t name = value;
+GATEWAY_ERRORS(CLIENT_ERROR_CONSTANT)
+#undef CLIENT_ERROR_CONSTANT
+
+// Gateway status returned by getStatus()
+#define CLIENT_STATUS_CONSTANT(name, value) const int8_t name = value;
+GATEWAY_STATUS(CLIENT_STATUS_CONSTANT)
+#undef CLIENT_STATUS_CONSTANT
+
 struct EnergyValues {
   float Voltage;     
   float Current;     
@@ -13,6 +24,40 @@ struct EnergyValues {
   float Total;       
 };
 
+// Event types returned by getEvents()
+const uint8_t EVENT_RELAY_CHANGED = 1;    // value: new relay state
+const uint8_t EVENT_PLUG_UNREACHABLE = 2;
+const uint8_t EVENT_PLUG_REACHABLE = 3;   // value: relay state
+const uint8_t EVENT_PLUG_RESTARTED = 4;   // value: relay state
+const uint8_t EVENT_RSSI_LOW = 5;         // value: rssi
+const uint8_t EVENT_RSSI_OK = 6;          // value: rssi
+
+struct GatewayEvent {
+  uint32_t timeMs;   // gateway millis() when the change was detected
+  uint8_t type;
+  uint8_t ipIndex;
+  uint8_t subIndex;
+  int8_t value;
+};
+
+const int8_t MAX_EVENTS_PER_READ = GatewayCodes::replySize(I2C_CMD_Events) / sizeof(GatewayEvent);
+
+// Rolling windows for getAggregate()
+const uint8_t WINDOW_1_MIN = 0;
+const uint8_t WINDOW_15_MIN = 1;
+const uint8_t WINDOW_1_HOUR = 2;
+const uint8_t FLEET_INDEX = 0xFF;   // ipIndex for totals across all plugs on the gateway
+
+struct AggregateValues {
+  float minPower;    // Watts
+  float maxPower;    // Watts
+  float meanPower;   // Watts
+  float energyWh;    // Watt hours since the gateway started
+};
+
+static_assert(GatewayCodes::replySize(I2C_CMD_Energy) == sizeof(EnergyValues), "Energy reply size does not match EnergyValues");
+static_assert(GatewayCodes::replySize(I2C_CMD_Aggregate) == sizeof(AggregateValues), "Aggregate reply size does not match AggregateValues");
+
 class TasmotaI2c {
 private:
     byte deviceAddress;  // I2C address of the slave device
@@ -26,33 +71,112 @@ public:
         Wire.setClock(100000);  // Set I2C clock speed to 100 kHz
     }
 
+    // One sendPowerOn(), sendRSSI(), ... per gateway command, each returns the completion code.
+    // Reply payloads are read by the wrappers below
+#define CLIENT_COMMAND_STUB(code, name, size, immediate)                        \
+    int8_t send##name(int8_t ipIndex = 0, int8_t subPlugIndex = 0) {           \
+        return sendCommand(code, ipIndex, subPlugIndex);                        \
+    }
+    GATEWAY_I2C_COMMANDS(CLIENT_COMMAND_STUB)
+#undef CLIENT_COMMAND_STUB
+
     bool powerOn(int8_t ipIndex = 0, int8_t subPlugIndex = 0) {
-        return checkCompletionCode(sendCommand('H', ipIndex, subPlugIndex));
+        return checkCompletionCode(sendPowerOn(ipIndex, subPlugIndex));
     }
 
     bool powerOff(int8_t ipIndex = 0, int8_t subPlugIndex = 0) {
-        return checkCompletionCode(sendCommand('L', ipIndex, subPlugIndex));
+        return checkCompletionCode(sendPowerOff(ipIndex, subPlugIndex));
     }
 
     int8_t getRSSI(int8_t ipIndex = 0, int8_t subPlugIndex = 0) {
-        return sendCommand('R', ipIndex, subPlugIndex);  // Directly return the RSSI or error code
+        return sendRSSI(ipIndex, subPlugIndex);  // Directly return the RSSI or error code
     }
 
     EnergyValues getEnergyValues(int8_t ipIndex = 0, int8_t subPlugIndex = 0) {
-        int8_t resultCode = sendCommand('E', ipIndex, subPlugIndex);
+        int8_t resultCode = sendEnergy(ipIndex, subPlugIndex);
         if (resultCode == RET_SUCCESS) {  // Check if resultCode indicates success
             return retrieveEnergyValues();
         }
         return EnergyValues(); // Return empty struct if error code received
     }
 
-private:
-    int8_t sendCommand(char cmd, int8_t ipIndex, int8_t subPlugIndex) {
+    // Reads power statistics over a rolling window for one plug, or FLEET_INDEX for all plugs
+    int8_t getAggregate(uint8_t ipIndex, uint8_t window, AggregateValues& values) {
+        int8_t resultCode = sendAggregate(ipIndex, window);
+        if (resultCode == RET_SUCCESS) {
+            Wire.requestFrom((int)deviceAddress, sizeof(AggregateValues));
+            if (Wire.available() != sizeof(AggregateValues)) {
+                return ERR_I2C_RESPONSE_TIMEOUT;
+            }
+            Wire.readBytes((char*)&values, sizeof(values));
+        }
+        return resultCode;
+    }
+
+    // Reads the range of global plug ids served by this gateway when gateways share a fleet
+    int8_t getShardInfo(uint8_t& firstPlugId, uint8_t& plugCount) {
+        int8_t resultCode = sendShardInfo();
+        if (resultCode == RET_SUCCESS) {
+            Wire.requestFrom((int)deviceAddress, (int)GatewayCodes::replySize(I2C_CMD_ShardInfo));
+            if (Wire.available() != GatewayCodes::replySize(I2C_CMD_ShardInfo)) {
+                return ERR_I2C_RESPONSE_TIMEOUT;
+            }
+            firstPlugId = Wire.read();
+            plugCount = Wire.read();
+        }
+        return resultCode;
+    }
+
+    // Sends a command without waiting for it to complete, so another gateway can be used meanwhile
+    void startCommand(char cmd, int8_t ipIndex, int8_t subPlugIndex) {
         Wire.beginTransmission(deviceAddress);
         Wire.write(cmd);
         Wire.write(ipIndex);
         Wire.write(subPlugIndex);
         Wire.endTransmission();
+    }
+
+    // Returns true with the completion code in resultCode once the gateway has finished the command
+    bool checkResponse(int8_t& resultCode) {
+        Wire.requestFrom((int)deviceAddress, 1);
+        if (Wire.available()) {
+            int8_t code = Wire.read();
+            if (code != ERR_BUSY) {
+                resultCode = code;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    unsigned long getResponseTimeout() const {
+        return responseTimeout;
+    }
+
+    // Reads up to MAX_EVENTS_PER_READ queued events, returns the number read or an error code
+    int8_t getEvents(GatewayEvent* events) {
+        int8_t count = sendEvents();
+        if (count > 0) {
+            Wire.requestFrom((int)deviceAddress, (int)(count * sizeof(GatewayEvent)));
+            if (Wire.available() != (int)(count * sizeof(GatewayEvent))) {
+                return ERR_I2C_RESPONSE_TIMEOUT;
+            }
+            Wire.readBytes((char*)events, count * sizeof(GatewayEvent));
+        }
+        return count;
+    }
+
+    int8_t getStatus() {
+        return sendStatus();  // Returns a STATUS_ value or error code
+    }
+
+    bool isReady() {
+        return getStatus() == STATUS_READY;
+    }
+
+private:
+    int8_t sendCommand(char cmd, int8_t ipIndex, int8_t subPlugIndex) {
+        startCommand(cmd, ipIndex, subPlugIndex);
 
         // Use adaptive polling to wait for response
         return pollForResponse();
@@ -60,14 +184,14 @@ private:
 
     int8_t pollForResponse() {
         unsigned long startTime = millis();
+        int8_t resultCode;
         while (millis() - startTime < responseTimeout) {
-            Wire.requestFrom((int)deviceAddress, 1);
-            if (Wire.available()) {
-                return Wire.read();  // Read the response
+            if (checkResponse(resultCode)) {
+                return resultCode;
             }
             delay(100);  // Adaptive delay to allow slave time to process the request
         }
-        return -100;  // Timeout error code
+        return ERR_I2C_RESPONSE_TIMEOUT;
     }
 
     bool checkCompletionCode(int8_t resultCode) {
@@ -88,3 +212,112 @@ private:
         return values;
     }
 };
+
+// Two gateways on one bus, each serving a range of global plug ids from its own access point.
+// Commands are routed by global plug id and setPower keeps both gateways busy at the same time.
+class TasmotaFleet {
+private:
+    static const uint8_t GATEWAY_COUNT = 2;
+    static const int8_t PENDING = 127;  // result placeholder for a command not yet sent
+    static const int8_t STARTED = 126;  // result placeholder for a command in progress
+    TasmotaI2c gateways[GATEWAY_COUNT];
+    uint8_t firstPlugId[GATEWAY_COUNT];
+    uint8_t plugCount[GATEWAY_COUNT];
+
+public:
+    TasmotaFleet() : gateways{TasmotaI2c(PRIMARY_I2C_ADDR), TasmotaI2c(SECONDARY_I2C_ADDR)} {}
+
+    // Reads the plug range of each gateway, returns the number of gateways that answered
+    int8_t begin() {
+        int8_t found = 0;
+        for (uint8_t g = 0; g < GATEWAY_COUNT; g++) {
+            gateways[g].begin();
+            plugCount[g] = 0;
+            if (gateways[g].getShardInfo(firstPlugId[g], plugCount[g]) == RET_SUCCESS) {
+                found++;
+            }
+        }
+        return found;
+    }
+
+    bool powerOn(uint8_t plugId) {
+        int8_t ipIndex;
+        int8_t g = route(plugId, ipIndex);
+        return g >= 0 && gateways[g].powerOn(ipIndex);
+    }
+
+    bool powerOff(uint8_t plugId) {
+        int8_t ipIndex;
+        int8_t g = route(plugId, ipIndex);
+        return g >= 0 && gateways[g].powerOff(ipIndex);
+    }
+
+    int8_t getRSSI(uint8_t plugId) {
+        int8_t ipIndex;
+        int8_t g = route(plugId, ipIndex);
+        return g >= 0 ? gateways[g].getRSSI(ipIndex) : ERR_PLUG_REF_INVALID;
+    }
+
+    EnergyValues getEnergyValues(uint8_t plugId) {
+        int8_t ipIndex;
+        int8_t g = route(plugId, ipIndex);
+        return g >= 0 ? gateways[g].getEnergyValues(ipIndex) : EnergyValues();
+    }
+
+    // Switches several plugs, with one command in progress on each gateway at a time.
+    // results receives the completion code for each plug
+    void setPower(const uint8_t* plugIds, const bool* states, uint8_t count, int8_t* results) {
+        int16_t active[GATEWAY_COUNT] = {-1, -1};  // index of the command running on each gateway, count can exceed 127
+        unsigned long startTime[GATEWAY_COUNT] = {0, 0};
+        uint8_t remaining = count;
+        for (uint8_t i = 0; i < count; i++) {
+            int8_t ipIndex;
+            results[i] = route(plugIds[i], ipIndex) >= 0 ? PENDING : ERR_PLUG_REF_INVALID;
+            if (results[i] != PENDING) {
+                remaining--;
+            }
+        }
+
+        while (remaining > 0) {
+            for (uint8_t g = 0; g < GATEWAY_COUNT; g++) {
+                if (active[g] < 0) {
+                    // start the next command for this gateway
+                    for (uint8_t i = 0; i < count; i++) {
+                        int8_t ipIndex;
+                        if (results[i] == PENDING && route(plugIds[i], ipIndex) == (int8_t)g) {
+                            results[i] = STARTED;
+                            gateways[g].startCommand(states[i] ? I2C_CMD_PowerOn : I2C_CMD_PowerOff, ipIndex, 0);
+                            active[g] = i;
+                            startTime[g] = millis();
+                            break;
+                        }
+                    }
+                } else {
+                    int8_t resultCode;
+                    if (gateways[g].checkResponse(resultCode)) {
+                        results[active[g]] = resultCode;
+                    } else if (millis() - startTime[g] >= gateways[g].getResponseTimeout()) {
+                        results[active[g]] = ERR_I2C_RESPONSE_TIMEOUT;
+                    } else {
+                        continue;
+                    }
+                    active[g] = -1;
+                    remaining--;
+                }
+            }
+            delay(10);
+        }
+    }
+
+private:
+    // Returns the gateway serving plugId and its IP index on that gateway, or -1 if no gateway has it
+    int8_t route(uint8_t plugId, int8_t& ipIndex) {
+        for (uint8_t g = 0; g < GATEWAY_COUNT; g++) {
+            if (plugId >= firstPlugId[g] && plugId < firstPlugId[g] + plugCount[g]) {
+                ipIndex = plugId - firstPlugId[g];
+                return g;
+            }
+        }
+        return -1;
+    }
+};
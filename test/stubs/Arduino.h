@@ -0,0 +1,211 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/*
+   Host stand-in for the parts of the Arduino core the gateway uses, for the native
+   test environment. Time is simulated: millis() and micros() only advance when code
+   calls delay(), so tests of timeouts and throughput run instantly and repeatably.
+   Each task has its own clock, see freertos/FreeRTOS.h.
+   Everything is header only so the stubs need no build rules of their own.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// simulated time of the calling task, see hostClockUs() in freertos/FreeRTOS.h
+inline unsigned long millis() { return (unsigned long)(hostClockUs().load() / 1000); }
+inline unsigned long micros() { return (unsigned long)hostClockUs().load(); }
+inline void delay(unsigned long ms) { hostClockUs() += (uint64_t)ms * 1000; }
+inline void delayMicroseconds(unsigned int us) { hostClockUs() += us; }
+inline void yield() {}
+
+// simulated input pins, tests set the level that digitalRead() returns
+inline int* hostPins() {
+    static int pins[64] = {0};
+    return pins;
+}
+inline void pinMode(int pin, int mode) {
+    if (pin >= 0 && pin < 64 && mode == INPUT_PULLUP) {
+        hostPins()[pin] = HIGH;
+    }
+}
+inline int digitalRead(int pin) { return (pin >= 0 && pin < 64) ? hostPins()[pin] : LOW; }
+inline void digitalWrite(int pin, int value) {
+    if (pin >= 0 && pin < 64) {
+        hostPins()[pin] = value;
+    }
+}
+
+class String {
+public:
+    String() {}
+    String(const char* text) : value(text ? text : "") {}
+    String(const std::string& text) : value(text) {}
+    String(int number) : value(std::to_string(number)) {}
+    const char* c_str() const { return value.c_str(); }
+    size_t length() const { return value.size(); }
+    int indexOf(const char* text) const { return find(value.find(text)); }
+    int indexOf(char c) const { return find(value.find(c)); }
+    String substring(size_t from) const { return from < value.size() ? String(value.substr(from)) : String(); }
+    String substring(size_t from, size_t to) const {
+        return from < value.size() && to > from ? String(value.substr(from, to - from)) : String();
+    }
+    void trim() {
+        size_t first = value.find_first_not_of(" \t\r\n");
+        size_t last = value.find_last_not_of(" \t\r\n");
+        value = first == std::string::npos ? "" : value.substr(first, last - first + 1);
+    }
+    long toInt() const { return atol(value.c_str()); }
+    float toFloat() const { return (float)atof(value.c_str()); }
+    bool startsWith(const char* prefix) const { return value.compare(0, strlen(prefix), prefix) == 0; }
+    bool operator==(const char* text) const { return value == text; }
+    String& operator+=(const String& other) { value += other.value; return *this; }
+    String operator+(const String& other) const { return String(value + other.value); }
+    friend String operator+(const char* text, const String& other) { return String(std::string(text) + other.value); }
+    bool concat(const char* text) { value += text; return true; }
+
+private:
+    std::string value;
+    static int find(size_t position) { return position == std::string::npos ? -1 : (int)position; }
+};
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* data, size_t length) {
+        size_t written = 0;
+        while (length--) {
+            written += write(*data++);
+        }
+        return written;
+    }
+    size_t write(const char* text) { return write(reinterpret_cast<const uint8_t*>(text), strlen(text)); }
+    size_t print(const char* text) { return write(text); }
+    size_t print(const String& text) { return write(text.c_str()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int number) { return printf("%d", number); }
+    size_t print(unsigned long number) { return printf("%lu", number); }
+    size_t print(double number, int digits = 2) { return printf("%.*f", digits, number); }
+    size_t println() { return write("\r\n"); }
+    template <typename T> size_t println(const T& value) { return print(value) + println(); }
+    size_t printf(const char* format, ...) {
+        char buffer[512];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length < 0) {
+            return 0;
+        }
+        return write(reinterpret_cast<const uint8_t*>(buffer), (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+    }
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long) {}
+    size_t readBytes(char* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = read();
+            if (c < 0) {
+                break;
+            }
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes(reinterpret_cast<char*>(buffer), length); }
+    String readStringUntil(char terminator) {
+        std::string text;
+        int c;
+        while ((c = read()) >= 0 && c != terminator) {
+            text += (char)c;
+        }
+        return String(text);
+    }
+};
+
+// Writes to stdout, tests can queue input with hostInput
+class HardwareSerial : public Stream {
+public:
+    std::string hostInput;
+    void begin(unsigned long) {}
+    int available() override { return (int)hostInput.size(); }
+    int read() override {
+        if (hostInput.empty()) {
+            return -1;
+        }
+        int c = (uint8_t)hostInput[0];
+        hostInput.erase(0, 1);
+        return c;
+    }
+    int peek() override { return hostInput.empty() ? -1 : (uint8_t)hostInput[0]; }
+    size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+    size_t write(const uint8_t* data, size_t length) override { return fwrite(data, 1, length, stdout); }
+    using Print::write;
+    operator bool() const { return true; }
+};
+
+inline HardwareSerial& hostSerial() {
+    static HardwareSerial serial;
+    return serial;
+}
+#define Serial hostSerial()
+
+// The host has no fixed heap, report a constant so heap deltas read as zero
+class EspClass {
+public:
+    uint32_t getFreeHeap() { return 320000; }
+    uint32_t getMaxAllocHeap() { return 110000; }
+    uint32_t getMinFreeHeap() { return 300000; }
+    void restart() {}
+};
+
+inline EspClass& hostEsp() {
+    static EspClass esp;
+    return esp;
+}
+#define ESP hostEsp()
+
+class IPAddress {
+public:
+    IPAddress() : octets{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : octets{a, b, c, d} {}
+    uint8_t operator[](int index) const { return octets[index]; }
+    String toString() const {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+        return String(text);
+    }
+
+private:
+    uint8_t octets[4];
+};
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,85 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <memory>
+#include "Arduino.h"
+
+// Files of the simulated flash file system live in LITTLEFS_HOST_DIR on the host
+#ifndef LITTLEFS_HOST_DIR
+#define LITTLEFS_HOST_DIR "."
+#endif
+
+namespace fs {
+
+class File : public Stream {
+public:
+    File() {}
+    explicit File(FILE* handle) {
+        if (handle != nullptr) {
+            file.reset(handle, fclose);
+        }
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t length) override { return file ? fwrite(data, 1, length, file.get()) : 0; }
+    using Print::write;
+    int available() override { return file ? (int)(size() - position()) : 0; }
+    int read() override { return file ? fgetc(file.get()) : -1; }
+    int peek() override {
+        int c = read();
+        if (c >= 0) {
+            ungetc(c, file.get());
+        }
+        return c;
+    }
+    size_t read(uint8_t* buffer, size_t length) { return file ? fread(buffer, 1, length, file.get()) : 0; }
+    bool seek(uint32_t position) { return file && fseek(file.get(), position, SEEK_SET) == 0; }
+    size_t position() const { return file ? (size_t)ftell(file.get()) : 0; }
+    size_t size() const {
+        if (!file) {
+            return 0;
+        }
+        long current = ftell(file.get());
+        fseek(file.get(), 0, SEEK_END);
+        long end = ftell(file.get());
+        fseek(file.get(), current, SEEK_SET);
+        return (size_t)end;
+    }
+    void flush() override {
+        if (file) {
+            fflush(file.get());
+        }
+    }
+    void close() { file.reset(); }
+    operator bool() const { return (bool)file; }
+
+private:
+    std::shared_ptr<FILE> file;
+};
+
+class FS {
+public:
+    bool begin(bool formatOnFail = false) { return true; }
+    File open(const char* path, const char* mode = "r") {
+        std::string fileMode = std::string(mode) + "b";
+        return File(fopen(hostPath(path).c_str(), fileMode.c_str()));
+    }
+    bool exists(const char* path) {
+        FILE* file = fopen(hostPath(path).c_str(), "rb");
+        if (file != nullptr) {
+            fclose(file);
+        }
+        return file != nullptr;
+    }
+    bool remove(const char* path) { return ::remove(hostPath(path).c_str()) == 0; }
+
+private:
+    static std::string hostPath(const char* path) { return std::string(LITTLEFS_HOST_DIR) + path; }
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif // HOST_FS_H
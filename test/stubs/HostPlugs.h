@@ -0,0 +1,86 @@
+#ifndef HOST_PLUGS_H
+#define HOST_PLUGS_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <thread>
+#include "WiFiClient.h"
+#include "TasmotaPlugs.h"
+
+// Simulated Tasmota plugs for the host tests: one single plug per address that answers the
+// Power, Status 10 and Status 11 commands the gateway sends. Tests switch a relay at the plug,
+// unplug it from the wall or slow it down through its entry in plugs. Plugs may be queried from
+// several tasks at once, the map itself is only changed by the test
+class HostPlugs : public HostNetwork {
+public:
+    struct Plug {
+        Plug() : reachable(true), power(1), watts(60), rssi(70), uptimeSec(100), latencyMs(0) {}
+        bool reachable;
+        int power;                  // relay state, switched by the Power commands
+        int watts;                  // drawn while the relay is on
+        int rssi;
+        unsigned long uptimeSec;
+        unsigned long latencyMs;    // simulated time the plug takes to answer
+    };
+
+    std::map<int, Plug> plugs;
+    std::atomic<int> requests;
+    std::atomic<int> heldOctet;   // this plug holds its reply in real time until released
+
+    HostPlugs() : requests(0), heldOctet(-1) {}
+
+    // Forgets the previous test's plugs, adds one answering plug per address, configures the
+    // gateway for them on consecutive pins and routes the simulated network here.
+    // plugsPerIp defaults to one plug per address
+    void configure(TasmotaPlugs& tasmotaPlugs, const std::vector<int>& ipOctets,
+                   const std::vector<int>& plugsPerIp = std::vector<int>()) {
+        plugs.clear();
+        requests = 0;
+        heldOctet = -1;
+        tasmotaPlugs.config.plug_ip = ipOctets;
+        tasmotaPlugs.config.plugs_per_ip = plugsPerIp.empty() ? std::vector<int>(ipOctets.size(), 1) : plugsPerIp;
+        tasmotaPlugs.config.esp_pin_map.clear();
+        for (size_t i = 0; i < ipOctets.size(); i++) {
+            plugs[ipOctets[i]] = Plug();
+            tasmotaPlugs.config.esp_pin_map.push_back(6 + (int)i);
+        }
+        tasmotaPlugs.initPlugStates();
+        hostNetwork() = this;
+    }
+
+    Plug& operator[](int ipOctet) { return plugs[ipOctet]; }
+
+    bool reachable(uint8_t ipOctet) override {
+        std::map<int, Plug>::iterator plug = plugs.find(ipOctet);
+        return plug != plugs.end() && plug->second.reachable;
+    }
+
+    std::string reply(uint8_t ipOctet, const std::string& request) override {
+        requests++;
+        Plug& plug = plugs.find(ipOctet)->second;
+        delay(plug.latencyMs);
+        while (heldOctet == ipOctet) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (request.find("cmnd=Power%20On ") != std::string::npos) {
+            plug.power = 1;
+        } else if (request.find("cmnd=Power%20Off ") != std::string::npos) {
+            plug.power = 0;
+        }
+        const char* state = plug.power ? "ON" : "OFF";
+        std::string body;
+        if (request.find("cmnd=Status%2010 ") != std::string::npos) {
+            body = "{\"StatusSNS\":{\"ENERGY\":{\"Total\":1.5,\"Yesterday\":0.2,\"Today\":0.1,\"Power\":" +
+                   std::to_string(plug.power ? plug.watts : 0) + ",\"Voltage\":230,\"Current\":0.26}}}";
+        } else if (request.find("cmnd=Status%2011 ") != std::string::npos) {
+            body = "{\"StatusSTS\":{\"UptimeSec\":" + std::to_string(plug.uptimeSec) + ",\"POWER\":\"" + state +
+                   "\",\"Wifi\":{\"RSSI\":" + std::to_string(plug.rssi) + "}}}";
+        } else {
+            body = std::string("{\"POWER\":\"") + state + "\"}";
+        }
+        return "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\n\r\n" + body;
+    }
+};
+
+#endif // HOST_PLUGS_H
@@ -0,0 +1,12 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include "FS.h"
+
+inline fs::FS& hostLittleFS() {
+    static fs::FS littleFS;
+    return littleFS;
+}
+#define LittleFS hostLittleFS()
+
+#endif // HOST_LITTLEFS_H
@@ -0,0 +1,6 @@
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+#include "Arduino.h"
+
+#endif // HOST_PRINT_H
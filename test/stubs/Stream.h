@@ -0,0 +1,6 @@
+#ifndef HOST_STREAM_H
+#define HOST_STREAM_H
+
+#include "Arduino.h"
+
+#endif // HOST_STREAM_H
@@ -0,0 +1,75 @@
+#ifndef HOST_WIFICLIENT_H
+#define HOST_WIFICLIENT_H
+
+#include "Arduino.h"
+
+// Simulated plugs on the access point network. A connection to an unreachable address
+// costs the whole connect timeout of simulated time, as it does on the device
+class HostNetwork {
+public:
+    virtual ~HostNetwork() {}
+    virtual bool reachable(uint8_t ipOctet) = 0;
+    // complete HTTP response, status line included, to a complete request
+    virtual std::string reply(uint8_t ipOctet, const std::string& request) = 0;
+};
+
+inline HostNetwork*& hostNetwork() {
+    static HostNetwork* network = nullptr;
+    return network;
+}
+
+class WiFiClient {
+public:
+    WiFiClient() : ipOctet(0), open(false), position(0) {}
+
+    int connect(IPAddress ip, uint16_t port, int32_t timeoutMs) {
+        stop();
+        if (hostNetwork() == nullptr || !hostNetwork()->reachable(ip[3])) {
+            delay(timeoutMs);
+            return 0;
+        }
+        ipOctet = ip[3];
+        open = true;
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t length) {
+        if (!open) {
+            return 0;
+        }
+        request.append(reinterpret_cast<const char*>(data), length);
+        if (request.find("\r\n\r\n") != std::string::npos && response.empty()) {
+            response = hostNetwork()->reply(ipOctet, request);
+            position = 0;
+        }
+        return length;
+    }
+
+    int available() { return open ? (int)(response.size() - position) : 0; }
+
+    int read(uint8_t* buffer, size_t length) {
+        size_t count = std::min(length, response.size() - position);
+        memcpy(buffer, response.data() + position, count);
+        position += count;
+        return (int)count;
+    }
+
+    // the plug closes the connection once the reply has been sent
+    uint8_t connected() { return open && position < response.size(); }
+
+    void stop() {
+        open = false;
+        request.clear();
+        response.clear();
+        position = 0;
+    }
+
+private:
+    uint8_t ipOctet;
+    bool open;
+    std::string request;
+    std::string response;
+    size_t position;
+};
+
+#endif // HOST_WIFICLIENT_H
@@ -0,0 +1,132 @@
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include <map>
+#include <vector>
+#include "Arduino.h"
+
+// A device on the simulated I2C bus, receives master writes and answers master reads
+class HostI2cDevice {
+public:
+    virtual ~HostI2cDevice() {}
+    virtual void receive(const uint8_t* data, size_t length) = 0;
+    virtual size_t request(uint8_t* data, size_t maxLength) = 0;
+};
+
+inline std::map<uint8_t, HostI2cDevice*>& hostI2cBus() {
+    static std::map<uint8_t, HostI2cDevice*> devices;
+    return devices;
+}
+
+/*
+   One Wire object serves both the gateway, as a slave registered with begin(address),
+   and a test acting as the master, so a test can drive the gateway's receive and request
+   handlers exactly as a master on the bus would.
+*/
+class TwoWire : public Stream, private HostI2cDevice {
+public:
+    TwoWire() : receiveHandler(nullptr), requestHandler(nullptr), inHandler(false), address(0), masterPosition(0),
+                slavePosition(0) {}
+
+    // slave
+    bool begin(uint8_t slaveAddress) {
+        hostI2cBus()[slaveAddress] = this;
+        return true;
+    }
+    void onReceive(void (*handler)(int)) { receiveHandler = handler; }
+    void onRequest(void (*handler)()) { requestHandler = handler; }
+
+    // master
+    bool begin() { return true; }
+    void setClock(uint32_t) {}
+    void beginTransmission(int target) {
+        address = (uint8_t)target;
+        transmit.clear();
+    }
+    uint8_t endTransmission(bool = true) {
+        std::map<uint8_t, HostI2cDevice*>::iterator device = hostI2cBus().find(address);
+        if (device == hostI2cBus().end()) {
+            return 2;   // address not acknowledged
+        }
+        device->second->receive(transmit.data(), transmit.size());
+        return 0;
+    }
+    size_t requestFrom(int target, int quantity) {
+        masterRx.clear();
+        masterPosition = 0;
+        std::map<uint8_t, HostI2cDevice*>::iterator device = hostI2cBus().find((uint8_t)target);
+        if (device != hostI2cBus().end() && quantity > 0) {
+            masterRx.resize(quantity);
+            masterRx.resize(device->second->request(masterRx.data(), quantity));
+        }
+        return masterRx.size();
+    }
+    size_t requestFrom(int target, size_t quantity) { return requestFrom(target, (int)quantity); }
+
+    // data for the master when inside onRequest, otherwise queued for the next transmission
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t length) override {
+        std::vector<uint8_t>& target = inHandler ? slaveTx : transmit;
+        target.insert(target.end(), data, data + length);
+        return length;
+    }
+    using Print::write;
+
+    // received bytes when inside onReceive, otherwise the reply to the last requestFrom
+    int available() override {
+        return inHandler ? (int)(slaveRx.size() - slavePosition) : (int)(masterRx.size() - masterPosition);
+    }
+    int read() override {
+        if (inHandler) {
+            return slavePosition < slaveRx.size() ? slaveRx[slavePosition++] : -1;
+        }
+        return masterPosition < masterRx.size() ? masterRx[masterPosition++] : -1;
+    }
+    int peek() override {
+        if (inHandler) {
+            return slavePosition < slaveRx.size() ? slaveRx[slavePosition] : -1;
+        }
+        return masterPosition < masterRx.size() ? masterRx[masterPosition] : -1;
+    }
+
+private:
+    void (*receiveHandler)(int);
+    void (*requestHandler)();
+    bool inHandler;
+    uint8_t address;
+    std::vector<uint8_t> transmit;
+    std::vector<uint8_t> masterRx;
+    size_t masterPosition;
+    std::vector<uint8_t> slaveRx;
+    size_t slavePosition;
+    std::vector<uint8_t> slaveTx;
+
+    void receive(const uint8_t* data, size_t length) override {
+        slaveRx.assign(data, data + length);
+        slavePosition = 0;
+        if (receiveHandler != nullptr) {
+            inHandler = true;
+            receiveHandler((int)length);
+            inHandler = false;
+        }
+    }
+    size_t request(uint8_t* data, size_t maxLength) override {
+        slaveTx.clear();
+        if (requestHandler != nullptr) {
+            inHandler = true;
+            requestHandler();
+            inHandler = false;
+        }
+        size_t length = std::min(maxLength, slaveTx.size());
+        memcpy(data, slaveTx.data(), length);
+        return length;
+    }
+};
+
+inline TwoWire& hostWire() {
+    static TwoWire wire;
+    return wire;
+}
+#define Wire hostWire()
+
+#endif // HOST_WIRE_H
@@ -0,0 +1,169 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+/*
+   Host stand-in for the FreeRTOS calls the gateway makes. Tasks are threads and critical
+   sections are spin locks. Each task keeps its own simulated clock, starting at the time
+   of the task that created it, so tasks run side by side in simulated time as they do on
+   the device. A semaphore give carries the giver's time: a take accepts a give made before
+   its deadline and moves the taker's clock on to it, and times out at its deadline once
+   every other task is past that deadline or has ended. Until then the take waits in real
+   time for the tasks to run.
+*/
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+struct portMUX_TYPE {
+    char locked;
+};
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) \
+    while (__atomic_test_and_set(&(mux)->locked, __ATOMIC_ACQUIRE)) { std::this_thread::yield(); }
+#define portEXIT_CRITICAL(mux) __atomic_clear(&(mux)->locked, __ATOMIC_RELEASE)
+
+// Simulated time in microseconds of the calling task. Threads not started by xTaskCreate share
+// the first clock, which starts at one second so zero can keep meaning "never"
+inline std::atomic<uint64_t>*& hostTaskClock() {
+    static thread_local std::atomic<uint64_t>* clock = nullptr;
+    return clock;
+}
+inline std::atomic<uint64_t>& hostClockUs() {
+    static std::atomic<uint64_t> firstClock(1000000);
+    std::atomic<uint64_t>*& clock = hostTaskClock();
+    if (clock == nullptr) {
+        clock = &firstClock;
+    }
+    return *clock;
+}
+
+// Clocks of the tasks started by xTaskCreate that have not ended
+struct HostTasks {
+    std::mutex mutex;
+    std::set<std::atomic<uint64_t>*> clocks;
+};
+inline HostTasks& hostTasks() {
+    static HostTasks tasks;
+    return tasks;
+}
+
+inline size_t hostTasksRunning() {
+    std::lock_guard<std::mutex> lock(hostTasks().mutex);
+    return hostTasks().clocks.size();
+}
+
+// Earliest simulated time at which a task other than the caller can still act
+inline uint64_t hostOtherTasksUs() {
+    std::lock_guard<std::mutex> lock(hostTasks().mutex);
+    uint64_t earliest = UINT64_MAX;
+    for (std::atomic<uint64_t>* clock : hostTasks().clocks) {
+        if (clock != &hostClockUs() && clock->load() < earliest) {
+            earliest = clock->load();
+        }
+    }
+    return earliest;
+}
+
+struct HostSemaphore {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::multiset<uint64_t> gives;   // simulated time of each give not yet taken
+    UBaseType_t maxCount;
+};
+typedef HostSemaphore* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+    SemaphoreHandle_t semaphore = new HostSemaphore();
+    for (UBaseType_t i = 0; i < initialCount; i++) {
+        semaphore->gives.insert(0);
+    }
+    semaphore->maxCount = maxCount;
+    return semaphore;
+}
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return xSemaphoreCreateCounting(1, 0); }
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return xSemaphoreCreateCounting(1, 1); }
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::atomic<uint64_t>& now = hostClockUs();
+    uint64_t deadline = ticks == portMAX_DELAY ? UINT64_MAX : now + (uint64_t)ticks * 1000;
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    while (semaphore->gives.empty() || *semaphore->gives.begin() > deadline) {
+        if (ticks == 0 || (ticks != portMAX_DELAY && hostOtherTasksUs() > deadline)) {
+            now = deadline;
+            return pdFALSE;
+        }
+        // task clocks move without notifying, so look again shortly
+        semaphore->changed.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    if (*semaphore->gives.begin() > now) {
+        now = *semaphore->gives.begin();
+    }
+    semaphore->gives.erase(semaphore->gives.begin());
+    return pdTRUE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    std::lock_guard<std::mutex> lock(semaphore->mutex);
+    if (semaphore->gives.size() >= semaphore->maxCount) {
+        return pdFALSE;
+    }
+    semaphore->gives.insert(hostClockUs().load());
+    semaphore->changed.notify_all();
+    return pdTRUE;
+}
+
+// thrown by vTaskDelete(nullptr) to end the calling task's thread
+struct HostTaskExit {};
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char*, uint32_t, void* param, UBaseType_t, TaskHandle_t* handle) {
+    // registered before the thread starts, so a take right after this waits for the task
+    std::shared_ptr<std::atomic<uint64_t>> clock = std::make_shared<std::atomic<uint64_t>>(hostClockUs().load());
+    {
+        std::lock_guard<std::mutex> lock(hostTasks().mutex);
+        hostTasks().clocks.insert(clock.get());
+    }
+    std::thread([function, param, clock] {
+        hostTaskClock() = clock.get();
+        try {
+            function(param);
+        } catch (const HostTaskExit&) {
+        }
+        std::lock_guard<std::mutex> lock(hostTasks().mutex);
+        hostTasks().clocks.erase(clock.get());
+    }).detach();
+    if (handle != nullptr) {
+        *handle = nullptr;
+    }
+    return pdPASS;
+}
+
+inline void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr) {
+        throw HostTaskExit();
+    }
+}
+
+inline void delay(unsigned long ms);   // simulated, defined in Arduino.h
+inline void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,67 @@
+/*
+   EnergyAggregator: the mean power of a window and the integrated energy use the same
+   trapezoid, so the mean multiplied by the sampled time gives the energy, and the energy
+   keeps its precision over weeks of samples.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <unity.h>
+#include "EnergyAggregator.h"
+#include "GatewayCommands.h"
+
+static DebugOutput logger;
+static EnergyAggregator aggregator;
+
+void setUp() {
+    aggregator = EnergyAggregator();
+    aggregator.begin(1, logger);
+}
+
+void tearDown() {}
+
+void test_mean_matches_energy() {
+    aggregator.addSample(0, 0, 0, millis());
+    delay(10000);
+    aggregator.addSample(0, 100, 100, millis());
+    delay(10000);
+    aggregator.addSample(0, 100, 100, millis());
+
+    AggregateValues values;
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, aggregator.getAggregate(0, WINDOW_1_MIN, values));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 75, values.meanPower);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 75 * 20 / 3600.0, values.energyWh);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 0, values.minPower);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 100, values.maxPower);
+}
+
+void test_fleet_mean_matches_energy() {
+    aggregator.addSample(0, 40, 40, millis());
+    delay(30000);
+    aggregator.addSample(0, 80, 80, millis());
+
+    AggregateValues values;
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, aggregator.getAggregate(EnergyAggregator::FLEET_INDEX, WINDOW_15_MIN, values));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 60, values.meanPower);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 60 * 30 / 3600.0, values.energyWh);
+}
+
+void test_energy_over_40_days() {
+    const unsigned long days = 40;
+    for (unsigned long sample = 0; sample <= days * 24 * 3600 * 2; sample++) {
+        aggregator.addSample(0, 1000, 1000, millis());
+        delay(500);
+    }
+
+    AggregateValues values;
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, aggregator.getAggregate(0, WINDOW_1_MIN, values));
+    float expectedWh = 1000.0f * 24 * days;
+    TEST_ASSERT_FLOAT_WITHIN(expectedWh * 0.001f, expectedWh, values.energyWh);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mean_matches_energy);
+    RUN_TEST(test_fleet_mean_matches_energy);
+    RUN_TEST(test_energy_over_40_days);
+    return UNITY_END();
+}
@@ -0,0 +1,81 @@
+/*
+   The device benchmarks timed on the PC against the wall clock, with optimisation on, so a
+   change to a hot path can be measured without flashing a gateway. Each result is a bench|
+   line on stdout, and when BENCH_OUTPUT names a file the results are also written there as
+   a JSON array.
+   Run with: pio test -e native_bench -v
+*/
+#include <Arduino.h>
+#include <HostPlugs.h>
+#include <chrono>
+#include <fstream>
+#include <unity.h>
+#include "Benchmark.h"
+#include "i2cInterface.h"
+
+static const uint32_t HOST_ITERATIONS = 100000;
+
+// Keeps the bench| lines for the JSON file and echoes them to stdout
+class ResultStream : public Stream {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return fputc(c, stdout) == EOF ? 0 : 1;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static HostPlugs fakePlugs;
+static DebugOutput logger;
+static TasmotaPlugs tasmotaPlugs;
+
+static uint64_t wallClockNs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void writeResults(const std::string& lines, const char* path) {
+    std::ofstream json(path);
+    json << "[\n";
+    size_t start = 0;
+    const char* separator = "";
+    while ((start = lines.find("bench|", start)) != std::string::npos) {
+        size_t end = lines.find('\n', start);
+        json << separator << "  " << lines.substr(start + 6, end - start - 6);
+        separator = ",\n";
+        start = end;
+    }
+    json << "\n]\n";
+}
+
+void setUp() {
+    fakePlugs.configure(tasmotaPlugs, {13, 12});
+    I2cInterface::begin(PRIMARY_I2C_ADDR, tasmotaPlugs, logger);
+}
+
+void tearDown() {}
+
+void test_benchmarks() {
+    ResultStream results;
+    Benchmark benchmark(results, HOST_ITERATIONS, wallClockNs);
+    benchmark.runPlugBenchmarks(tasmotaPlugs);
+    benchmark.run("i2c_encode_energy_reply", I2cInterface::benchmarkReplyEncoding, nullptr);
+
+    const char* names[] = {"parse_power", "parse_status_10_energy", "parse_status_11_rssi", "parse_status_11_state",
+                           "plug_ip_address", "error_string", "debug_output_format", "i2c_encode_energy_reply"};
+    for (const char* name : names) {
+        TEST_ASSERT_TRUE_MESSAGE(results.text.find(std::string("\"name\":\"") + name + "\"") != std::string::npos, name);
+    }
+    if (getenv("BENCH_OUTPUT") != nullptr) {
+        writeResults(results.text, getenv("BENCH_OUTPUT"));
+    }
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_benchmarks);
+    return UNITY_END();
+}
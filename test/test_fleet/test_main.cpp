@@ -0,0 +1,133 @@
+/*
+   Fleet simulation: the Arduino client's TasmotaFleet drives one or two simulated gateways on the
+   simulated I2C bus. Each gateway takes a fixed time to switch a plug, so splitting the plugs
+   between two gateways should roughly double the rate at which setPower switches them.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <Wire.h>
+#include <unity.h>
+#include "TasmotaI2c.h"
+
+// A gateway that takes switchMs of simulated time to switch a plug and answers ERR_BUSY meanwhile
+class SimGateway : public HostI2cDevice {
+public:
+    static const unsigned long switchMs = 200;
+
+    SimGateway(uint8_t first, uint8_t count) : firstPlugId(first), plugCount(count), busy(false), code(RET_SUCCESS),
+                                               payloadLength(0), switched(0) {}
+
+    void receive(const uint8_t* data, size_t length) override {
+        if (length != 3) {
+            return;
+        }
+        char cmd = data[0];
+        startMs = millis();
+        busy = cmd == I2C_CMD_PowerOn || cmd == I2C_CMD_PowerOff;
+        code = data[1] < plugCount || cmd == I2C_CMD_ShardInfo ? RET_SUCCESS : ERR_PLUG_REF_INVALID;
+        payloadLength = 0;
+        if (cmd == I2C_CMD_ShardInfo) {
+            payload[0] = firstPlugId;
+            payload[1] = plugCount;
+            payloadLength = 2;
+        }
+    }
+
+    size_t request(uint8_t* data, size_t maxLength) override {
+        if (busy && millis() - startMs < switchMs) {
+            data[0] = (uint8_t)ERR_BUSY;
+            return 1;
+        }
+        if (busy) {
+            busy = false;
+            switched++;
+        }
+        if (payloadLength > 0 && maxLength == payloadLength) {
+            memcpy(data, payload, payloadLength);
+            payloadLength = 0;
+            return maxLength;
+        }
+        data[0] = (uint8_t)code;
+        return 1;
+    }
+
+    uint8_t firstPlugId;
+    uint8_t plugCount;
+    bool busy;
+    int8_t code;
+    unsigned long startMs;
+    uint8_t payload[2];
+    size_t payloadLength;
+    int switched;
+};
+
+static const uint8_t PLUG_COUNT = 8;
+
+// Switches every plug of the fleet on and returns the simulated time taken
+static unsigned long switchAll(TasmotaFleet& fleet, uint8_t count) {
+    uint8_t plugIds[255];
+    bool states[255];
+    int8_t results[255];
+    for (uint8_t i = 0; i < count; i++) {
+        plugIds[i] = i % PLUG_COUNT;
+        states[i] = true;
+    }
+    unsigned long startMs = millis();
+    fleet.setPower(plugIds, states, count, results);
+    unsigned long elapsedMs = millis() - startMs;
+    for (uint8_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL(RET_SUCCESS, results[i]);
+    }
+    return elapsedMs;
+}
+
+void setUp() {
+    hostI2cBus().clear();
+}
+
+void tearDown() {
+    hostI2cBus().clear();
+}
+
+void test_two_gateways_double_throughput() {
+    SimGateway single(0, PLUG_COUNT);
+    hostI2cBus()[PRIMARY_I2C_ADDR] = &single;
+    TasmotaFleet oneGateway;
+    TEST_ASSERT_EQUAL(1, oneGateway.begin());
+    unsigned long singleMs = switchAll(oneGateway, PLUG_COUNT);
+    TEST_ASSERT_EQUAL(PLUG_COUNT, single.switched);
+
+    hostI2cBus().clear();
+    SimGateway primary(0, PLUG_COUNT / 2);
+    SimGateway secondary(PLUG_COUNT / 2, PLUG_COUNT / 2);
+    hostI2cBus()[PRIMARY_I2C_ADDR] = &primary;
+    hostI2cBus()[SECONDARY_I2C_ADDR] = &secondary;
+    TasmotaFleet twoGateways;
+    TEST_ASSERT_EQUAL(2, twoGateways.begin());
+    unsigned long pairMs = switchAll(twoGateways, PLUG_COUNT);
+    TEST_ASSERT_EQUAL(PLUG_COUNT / 2, primary.switched);
+    TEST_ASSERT_EQUAL(PLUG_COUNT / 2, secondary.switched);
+
+    float speedup = (float)singleMs / pairMs;
+    printf("fleet|plugs=%d,oneGatewayMs=%lu,twoGatewaysMs=%lu,speedup=%.2f\n", PLUG_COUNT, singleMs, pairMs, speedup);
+    TEST_ASSERT_FLOAT_WITHIN(0.2, 2.0, speedup);
+}
+
+void test_more_than_127_commands() {
+    SimGateway primary(0, PLUG_COUNT / 2);
+    SimGateway secondary(PLUG_COUNT / 2, PLUG_COUNT / 2);
+    hostI2cBus()[PRIMARY_I2C_ADDR] = &primary;
+    hostI2cBus()[SECONDARY_I2C_ADDR] = &secondary;
+    TasmotaFleet fleet;
+    TEST_ASSERT_EQUAL(2, fleet.begin());
+    switchAll(fleet, 200);
+    TEST_ASSERT_EQUAL(100, primary.switched);
+    TEST_ASSERT_EQUAL(100, secondary.switched);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_two_gateways_double_throughput);
+    RUN_TEST(test_more_than_127_commands);
+    return UNITY_END();
+}
@@ -0,0 +1,85 @@
+/*
+   Load shedding against simulated plugs: a plug switched outside the shedder is released,
+   so it can be shed again when switched on and is not switched back on when switched off.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <HostPlugs.h>
+#include <unity.h>
+#include "LoadShedder.h"
+
+static HostPlugs fakePlugs;
+static DebugOutput logger;
+static TasmotaPlugs tasmotaPlugs;
+static Telemetry telemetry;
+static LoadShedder loadShedder;
+
+// wired as in main.cpp, so every reading added to telemetry is checked against the budget
+static void onTelemetrySample(int ipIndex) {
+    loadShedder.onSample(ipIndex);
+}
+
+static void reading(int ipIndex, float power) {
+    EnergyValues values = {};
+    values.Power = power;
+    telemetry.addSample(ipIndex, values);
+}
+
+void setUp() {
+    tasmotaPlugs.config.plug_priority = {1, 2};
+    tasmotaPlugs.config.power_budget = 100;
+    tasmotaPlugs.config.power_hysteresis = 10;
+    fakePlugs.configure(tasmotaPlugs, {13, 12});
+    telemetry = Telemetry();
+    telemetry.begin(tasmotaPlugs, logger, 60000);
+    telemetry.setListener(onTelemetrySample);
+    loadShedder = LoadShedder();
+    loadShedder.begin(tasmotaPlugs, telemetry, logger);
+}
+
+void tearDown() {}
+
+void test_sheds_lowest_priority() {
+    reading(1, 60);
+    reading(0, 80);
+    TEST_ASSERT_EQUAL(0, fakePlugs[13].power);
+    TEST_ASSERT_EQUAL(1, fakePlugs[12].power);
+}
+
+void test_released_plug_switched_on_is_shed_again() {
+    reading(1, 60);
+    reading(0, 80);
+    TEST_ASSERT_EQUAL(0, fakePlugs[13].power);
+    // the master switches the shed plug back on
+    loadShedder.release(0);
+    TEST_ASSERT_EQUAL(TasmotaPlugs::RET_SUCCESS, tasmotaPlugs.setPlugState(0, 0, true));
+    reading(0, 80);
+    TEST_ASSERT_EQUAL(0, fakePlugs[13].power);
+}
+
+void test_released_plug_switched_off_is_not_restored() {
+    reading(1, 60);
+    reading(0, 80);
+    TEST_ASSERT_EQUAL(0, fakePlugs[13].power);
+    loadShedder.release(0);
+    delay(LoadShedder::RESTORE_HOLDOFF_MS + 1);
+    reading(1, 5);
+    TEST_ASSERT_EQUAL(0, fakePlugs[13].power);
+}
+
+void test_shed_plug_is_restored() {
+    reading(1, 60);
+    reading(0, 80);
+    delay(LoadShedder::RESTORE_HOLDOFF_MS + 1);
+    reading(1, 5);
+    TEST_ASSERT_EQUAL(1, fakePlugs[13].power);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_sheds_lowest_priority);
+    RUN_TEST(test_released_plug_switched_on_is_shed_again);
+    RUN_TEST(test_released_plug_switched_off_is_not_restored);
+    RUN_TEST(test_shed_plug_is_restored);
+    return UNITY_END();
+}
@@ -0,0 +1,74 @@
+/*
+   PlugMonitor against simulated plugs: polls take their turn in the shared request budget,
+   addresses without plugs are skipped and relay changes made at the plug are reported.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <HostPlugs.h>
+#include <unity.h>
+#include "PlugMonitor.h"
+
+static HostPlugs fakePlugs;
+static DebugOutput logger;
+static TasmotaPlugs tasmotaPlugs;
+static EventQueue events;
+static PlugMonitor plugMonitor;
+static int changedIndex;
+
+static void onRelayChange(int ipIndex) {
+    changedIndex = ipIndex;
+}
+
+void setUp() {
+    fakePlugs.configure(tasmotaPlugs, {13, 14, 12}, {1, 0, 1});
+    tasmotaPlugs.setRequestRate(10);
+    events = EventQueue();
+    plugMonitor = PlugMonitor();
+    plugMonitor.begin(tasmotaPlugs, events, logger, 3000);
+    plugMonitor.setListener(onRelayChange);
+    changedIndex = -1;
+    delay(1000);
+}
+
+void tearDown() {}
+
+void test_waits_for_request_budget() {
+    StateStatus status;
+    TEST_ASSERT_EQUAL(TasmotaPlugs::RET_SUCCESS, tasmotaPlugs.getStateStatus(0, 0, status));
+    TEST_ASSERT_EQUAL(-1, plugMonitor.service());
+    delay(100);
+    TEST_ASSERT_EQUAL(0, plugMonitor.service());
+    TEST_ASSERT_EQUAL(2, fakePlugs.requests);
+}
+
+void test_skips_address_without_plugs() {
+    TEST_ASSERT_EQUAL(0, plugMonitor.service());
+    delay(1000);
+    TEST_ASSERT_EQUAL(-1, plugMonitor.service());
+    delay(1000);
+    TEST_ASSERT_EQUAL(2, plugMonitor.service());
+    TEST_ASSERT_EQUAL(2, fakePlugs.requests);
+}
+
+void test_reports_external_relay_change() {
+    TEST_ASSERT_EQUAL(0, plugMonitor.service());
+    fakePlugs[13].power = 0;
+    delay(3000);
+    plugMonitor.service();
+    plugMonitor.service();
+    delay(1000);
+    TEST_ASSERT_EQUAL(0, plugMonitor.service());
+    TEST_ASSERT_EQUAL(0, changedIndex);
+    TEST_ASSERT_EQUAL(0, tasmotaPlugs.plugs[0][0].plugState);
+    GatewayEvent event;
+    TEST_ASSERT_EQUAL(1, events.pop(&event, 1));
+    TEST_ASSERT_EQUAL(EVENT_RELAY_CHANGED, event.type);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_waits_for_request_budget);
+    RUN_TEST(test_skips_address_without_plugs);
+    RUN_TEST(test_reports_external_relay_change);
+    return UNITY_END();
+}
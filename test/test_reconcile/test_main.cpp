@@ -0,0 +1,80 @@
+/*
+   Startup reconciliation against simulated plugs: every address is queried by its own task, so
+   the wait is that of the slowest plug rather than the sum of all of them, and a task still
+   waiting for its plug when reconcilePlugStates gives up never writes to plugs.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <HostPlugs.h>
+#include <unity.h>
+#include "TasmotaPlugs.h"
+
+static const uint32_t RECONCILE_TIMEOUT_MS = 2000;
+
+static HostPlugs fakePlugs;
+static TasmotaPlugs tasmotaPlugs;
+
+void setUp() {
+    fakePlugs.configure(tasmotaPlugs, {13, 12, 14});
+    fakePlugs[13].power = 1;
+    fakePlugs[12].power = 0;
+    fakePlugs[14].power = 1;
+}
+
+void tearDown() {
+    fakePlugs.heldOctet = -1;
+    while (hostTasksRunning() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void test_wait_is_the_slowest_plug() {
+    fakePlugs[12].latencyMs = 800;
+    fakePlugs[14].latencyMs = 300;
+    unsigned long startMs = millis();
+    TEST_ASSERT_EQUAL(3, tasmotaPlugs.reconcilePlugStates(RECONCILE_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(800, millis() - startMs);
+    TEST_ASSERT_EQUAL(1, tasmotaPlugs.plugs[0][0].plugState);
+    TEST_ASSERT_EQUAL(0, tasmotaPlugs.plugs[1][0].plugState);
+    TEST_ASSERT_EQUAL(1, tasmotaPlugs.plugs[2][0].plugState);
+}
+
+void test_unreachable_plug_gives_up_at_the_deadline() {
+    fakePlugs[12].latencyMs = 800;
+    fakePlugs[14].reachable = false;
+    unsigned long startMs = millis();
+    TEST_ASSERT_EQUAL(2, tasmotaPlugs.reconcilePlugStates(RECONCILE_TIMEOUT_MS));
+    // the unreachable plug's task stops retrying at the deadline, after its last 250 ms pause
+    unsigned long elapsedMs = millis() - startMs;
+    TEST_ASSERT_GREATER_OR_EQUAL(RECONCILE_TIMEOUT_MS, elapsedMs);
+    TEST_ASSERT_LESS_OR_EQUAL(RECONCILE_TIMEOUT_MS + 250, elapsedMs);
+    TEST_ASSERT_EQUAL(0, tasmotaPlugs.plugs[1][0].plugState);
+    TEST_ASSERT_EQUAL(-1, tasmotaPlugs.plugs[2][0].plugState);
+}
+
+void test_abandoned_task_never_writes_plugs() {
+    // plug 14 answers long after reconcilePlugStates has stopped waiting, and its task is
+    // still running when the call returns
+    fakePlugs[14].latencyMs = RECONCILE_TIMEOUT_MS + TasmotaPlugs::HTTP_TIMEOUT_MS + 1000;
+    fakePlugs.heldOctet = 14;
+    unsigned long startMs = millis();
+    TEST_ASSERT_EQUAL(2, tasmotaPlugs.reconcilePlugStates(RECONCILE_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(RECONCILE_TIMEOUT_MS + TasmotaPlugs::HTTP_TIMEOUT_MS, millis() - startMs);
+    TEST_ASSERT_EQUAL(1, hostTasksRunning());
+
+    fakePlugs.heldOctet = -1;
+    while (hostTasksRunning() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    TEST_ASSERT_EQUAL(3, fakePlugs.requests);
+    TEST_ASSERT_EQUAL(-1, tasmotaPlugs.plugs[2][0].plugState);
+    TEST_ASSERT_EQUAL(1, tasmotaPlugs.plugs[0][0].plugState);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_wait_is_the_slowest_plug);
+    RUN_TEST(test_unreachable_plug_gives_up_at_the_deadline);
+    RUN_TEST(test_abandoned_task_never_writes_plugs);
+    return UNITY_END();
+}
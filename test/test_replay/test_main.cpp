@@ -0,0 +1,167 @@
+/*
+   Host replayer: drives the gateway's I2C handlers over the simulated bus with simulated plugs,
+   captures the traffic to /trace.bin and replays it, checking that the replay reproduces the
+   recorded completion codes without touching the network or the live gateway state. Requests
+   the gateway made on its own between commands are skipped rather than counted as mismatches.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <Wire.h>
+#include <LittleFS.h>
+#include <HostPlugs.h>
+#include <unity.h>
+#include "i2cInterface.h"
+
+class CaptureStream : public Stream {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static HostPlugs fakePlugs;
+static DebugOutput logger;
+static TasmotaPlugs tasmotaPlugs;
+static TrafficTrace trafficTrace;
+static EventQueue events;
+static Telemetry telemetry;
+static EnergyAggregator aggregator;
+static I2cInterface gateway;
+
+// The master's side of a command: write it, let the gateway loop run, then read the completion code
+static void sendCommand(char cmd, uint8_t index, uint8_t subIndex) {
+    Wire.beginTransmission(PRIMARY_I2C_ADDR);
+    Wire.write((uint8_t)cmd);
+    Wire.write(index);
+    Wire.write(subIndex);
+    Wire.endTransmission();
+}
+
+static int8_t readCode() {
+    Wire.requestFrom(PRIMARY_I2C_ADDR, 1);
+    return (int8_t)Wire.read();
+}
+
+static int8_t runCommand(char cmd, uint8_t index, uint8_t subIndex) {
+    sendCommand(cmd, index, subIndex);
+    gateway.service();
+    int8_t code = readCode();
+    uint8_t size = GatewayCodes::replySize(cmd);
+    if (code >= 0 && size > 0 && !(cmd == I2C_CMD_Events && code == 0)) {
+        Wire.requestFrom(PRIMARY_I2C_ADDR, (int)size);
+        while (Wire.available()) {
+            Wire.read();
+        }
+    }
+    return code;
+}
+
+static void captureTrace() {
+    TEST_ASSERT_TRUE(trafficTrace.startCapture(TrafficTrace::SINK_FILE));
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, runCommand(I2C_CMD_PowerOn, 0, 0));
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, runCommand(I2C_CMD_Energy, 0, 0));
+    TEST_ASSERT_EQUAL(70, runCommand(I2C_CMD_RSSI, 1, 0));
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, runCommand(I2C_CMD_PowerOff, 1, 0));
+    TEST_ASSERT_EQUAL(0, runCommand(I2C_CMD_Events, 0, 0));
+    trafficTrace.stopCapture();
+}
+
+void setUp() {
+    fakePlugs.configure(tasmotaPlugs, {13, 12});
+    fakePlugs[13].power = 0;
+    fakePlugs[12].power = 0;
+    tasmotaPlugs.setTrace(&trafficTrace);
+    trafficTrace.begin(logger);
+    events = EventQueue();
+    telemetry.begin(tasmotaPlugs, logger, 60000);
+    aggregator.begin(tasmotaPlugs.plugs.size(), logger);
+    I2cInterface::begin(PRIMARY_I2C_ADDR, tasmotaPlugs, logger);
+    I2cInterface::setTrace(&trafficTrace);
+    I2cInterface::setEventQueue(&events);
+    I2cInterface::setTelemetry(&telemetry);
+    I2cInterface::setAggregator(&aggregator);
+    I2cInterface::setGatewayStatus(GatewayCodes::STATUS_READY);
+}
+
+void tearDown() {
+    LittleFS.remove(TrafficTrace::TRACE_FILE);
+}
+
+void test_replay_matches_recording() {
+    captureTrace();
+    int requests = fakePlugs.requests;
+    CaptureStream output;
+    I2cInterface::replay(trafficTrace, false, output);
+    TEST_ASSERT_TRUE(output.text.find("replay|commands=5,") != std::string::npos);
+    TEST_ASSERT_TRUE(output.text.find("codeMismatches=0,requestMismatches=0") != std::string::npos);
+    TEST_ASSERT_EQUAL(requests, fakePlugs.requests);
+}
+
+void test_replay_skips_background_requests() {
+    TEST_ASSERT_TRUE(trafficTrace.startCapture(TrafficTrace::SINK_FILE));
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, runCommand(I2C_CMD_PowerOn, 0, 0));
+    delay(1000);
+    TEST_ASSERT_TRUE(telemetry.service() >= 0);   // a poll between two commands
+    TEST_ASSERT_EQUAL(70, runCommand(I2C_CMD_RSSI, 1, 0));
+    trafficTrace.stopCapture();
+
+    CaptureStream output;
+    I2cInterface::replay(trafficTrace, false, output);
+    TEST_ASSERT_TRUE(output.text.find("replay|commands=2,") != std::string::npos);
+    TEST_ASSERT_TRUE(output.text.find("codeMismatches=0,requestMismatches=0,backgroundRequests=1") != std::string::npos);
+}
+
+void test_replay_leaves_gateway_state() {
+    captureTrace();
+    // live state that differs from what the replayed commands would leave behind
+    tasmotaPlugs.plugs[0][0].plugState = 0;
+    tasmotaPlugs.plugs[1][0].plugState = 1;
+    events.push(EVENT_PLUG_RESTARTED, 1, 0, 1);
+    unsigned long sampleMs = telemetry.sample(0).timeMs;
+    delay(10);
+    sendCommand(I2C_CMD_RSSI, 1, 0);   // command the master sent just before the replay
+
+    CaptureStream output;
+    I2cInterface::replay(trafficTrace, false, output);
+
+    TEST_ASSERT_EQUAL(0, tasmotaPlugs.plugs[0][0].plugState);
+    TEST_ASSERT_EQUAL(1, tasmotaPlugs.plugs[1][0].plugState);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_EQUAL(sampleMs, telemetry.sample(0).timeMs);
+    gateway.service();
+    TEST_ASSERT_EQUAL(70, readCode());
+}
+
+void test_status_keeps_pending_command() {
+    sendCommand(I2C_CMD_RSSI, 1, 0);
+    sendCommand(I2C_CMD_Status, 0, 0);
+    TEST_ASSERT_EQUAL(GatewayCodes::STATUS_READY, readCode());
+    gateway.service();
+    TEST_ASSERT_EQUAL(70, readCode());
+}
+
+void test_benchmark_keeps_pending_reply() {
+    sendCommand(I2C_CMD_Energy, 0, 0);
+    gateway.service();
+    I2cInterface::benchmarkReplyEncoding(nullptr);
+    TEST_ASSERT_EQUAL(GatewayCodes::RET_SUCCESS, readCode());
+    EnergyValues values;
+    TEST_ASSERT_EQUAL(sizeof(values), Wire.requestFrom(PRIMARY_I2C_ADDR, (int)sizeof(values)));
+    Wire.readBytes((char*)&values, sizeof(values));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 230, values.Voltage);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_matches_recording);
+    RUN_TEST(test_replay_skips_background_requests);
+    RUN_TEST(test_replay_leaves_gateway_state);
+    RUN_TEST(test_status_keeps_pending_command);
+    RUN_TEST(test_benchmark_keeps_pending_reply);
+    return UNITY_END();
+}
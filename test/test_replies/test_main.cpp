@@ -0,0 +1,94 @@
+/*
+   Parsing of replies recorded from a Tasmota 13 smart plug, the completion code strings, and the
+   client sketch's copy of the command tables.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <fstream>
+#include <sstream>
+#include <unity.h>
+#include "TasmotaPlugs.h"
+
+static const char STATUS_10_REPLY[] =
+    "{\"StatusSNS\":{\"Time\":\"2024-04-20T12:00:00\",\"ENERGY\":{\"TotalStartTime\":\"2023-11-05T10:21:44\","
+    "\"Total\":12.345,\"Yesterday\":0.512,\"Today\":0.231,\"Power\":57,\"ApparentPower\":63,\"ReactivePower\":27,"
+    "\"Factor\":0.90,\"Voltage\":231,\"Current\":0.272}}}";
+static const char STATUS_11_REPLY[] =
+    "{\"StatusSTS\":{\"Time\":\"2024-04-20T12:00:00\",\"Uptime\":\"0T02:13:45\",\"UptimeSec\":8025,\"Heap\":25,"
+    "\"SleepMode\":\"Dynamic\",\"Sleep\":50,\"LoadAvg\":19,\"MqttCount\":0,\"POWER\":\"OFF\",\"Wifi\":{\"AP\":1,"
+    "\"SSId\":\"plugAP3341\",\"BSSId\":\"34:85:18:6A:33:41\",\"Channel\":1,\"Mode\":\"11n\",\"RSSI\":78,"
+    "\"Signal\":-61,\"LinkCount\":1,\"Downtime\":\"0T00:00:03\"}}}";
+
+// The parsers deserialize in place, so each test parses its own copy
+static char scratch[sizeof(STATUS_11_REPLY)];
+
+static char* reply(const char* text) {
+    strcpy(scratch, text);
+    return scratch;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_parse_power_state() {
+    TEST_ASSERT_EQUAL(1, TasmotaPlugs::parsePowerState(reply("{\"POWER\":\"ON\"}")));
+    TEST_ASSERT_EQUAL(0, TasmotaPlugs::parsePowerState(reply("{\"POWER\":\"OFF\"}")));
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_UNKNOWN_STATE, TasmotaPlugs::parsePowerState(reply("{\"Command\":\"Unknown\"}")));
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_JSON_ERROR, TasmotaPlugs::parsePowerState(reply("{\"POWER\":")));
+}
+
+void test_parse_energy_values() {
+    EnergyValues values;
+    TEST_ASSERT_EQUAL(TasmotaPlugs::RET_SUCCESS, TasmotaPlugs::parseEnergyValues(reply(STATUS_10_REPLY), values));
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 231, values.Voltage);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.272, values.Current);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 57, values.Power);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.512, values.Yesterday);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.231, values.Today);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 12.345, values.Total);
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_JSON_ERROR, TasmotaPlugs::parseEnergyValues(reply("HTTP/1.0"), values));
+}
+
+void test_parse_state_status() {
+    StateStatus status;
+    TEST_ASSERT_EQUAL(TasmotaPlugs::RET_SUCCESS, TasmotaPlugs::parseStateStatus(reply(STATUS_11_REPLY), status));
+    TEST_ASSERT_EQUAL(0, status.power);
+    TEST_ASSERT_EQUAL(78, status.rssi);
+    TEST_ASSERT_EQUAL(8025, status.uptimeSec);
+    TEST_ASSERT_EQUAL(78, TasmotaPlugs::parseRSSI(reply(STATUS_11_REPLY)));
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_UNKNOWN_STATE, TasmotaPlugs::parseStateStatus(reply("{\"StatusSTS\":{}}"), status));
+}
+
+void test_error_strings() {
+    TEST_ASSERT_EQUAL_STRING("Success", GatewayCodes::errorString(GatewayCodes::RET_SUCCESS));
+    TEST_ASSERT_EQUAL_STRING("Invalid plug reference", GatewayCodes::errorString(GatewayCodes::ERR_PLUG_REF_INVALID));
+    TEST_ASSERT_EQUAL_STRING("Gateway starting", GatewayCodes::errorString(GatewayCodes::ERR_NOT_READY));
+    TEST_ASSERT_EQUAL_STRING("Unknown error", GatewayCodes::errorString(-50));
+    TEST_ASSERT_EQUAL_STRING("Gateway busy", TasmotaPlugs::getErrorString(TasmotaPlugs::ERR_BUSY));
+}
+
+// __FILE__ is either relative to the project directory, where the tests run, or absolute
+static std::string readProjectFile(const char* path) {
+    std::string self = __FILE__;
+    std::ifstream input(self.substr(0, self.rfind("test/test_replies/")) + path, std::ios::binary);
+    std::stringstream content;
+    content << input.rdbuf();
+    return content.str();
+}
+
+void test_client_command_tables_match() {
+    std::string gateway = readProjectFile("src/GatewayCommands.h");
+    TEST_ASSERT_TRUE(gateway.find("GATEWAY_I2C_COMMANDS") != std::string::npos);
+    TEST_ASSERT_TRUE_MESSAGE(gateway == readProjectFile("test/I2cTest/GatewayCommands.h"),
+                             "test/I2cTest/GatewayCommands.h differs from src/GatewayCommands.h");
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_parse_power_state);
+    RUN_TEST(test_parse_energy_values);
+    RUN_TEST(test_parse_state_status);
+    RUN_TEST(test_error_strings);
+    RUN_TEST(test_client_command_tables_match);
+    return UNITY_END();
+}
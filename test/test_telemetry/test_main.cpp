@@ -0,0 +1,62 @@
+/*
+   Telemetry against simulated plugs: background polls share one request budget with every
+   other request to the plugs and give up on an unreachable plug sooner than a command does.
+   Run with: pio test -e native
+*/
+#include <Arduino.h>
+#include <HostPlugs.h>
+#include <unity.h>
+#include "Telemetry.h"
+
+static HostPlugs fakePlugs;
+static DebugOutput logger;
+static TasmotaPlugs tasmotaPlugs;
+static Telemetry telemetry;
+
+void setUp() {
+    fakePlugs.configure(tasmotaPlugs, {12, 13});
+    fakePlugs[12].reachable = false;   // switched off at the wall
+    tasmotaPlugs.setRequestRate(2);
+    telemetry = Telemetry();
+    telemetry.begin(tasmotaPlugs, logger, 60000);
+    delay(1000);
+}
+
+void tearDown() {}
+
+void test_command_uses_the_budget() {
+    TEST_ASSERT_EQUAL(70, tasmotaPlugs.getRSSI(1, 0));
+    TEST_ASSERT_EQUAL(-1, telemetry.service());
+    delay(499);
+    TEST_ASSERT_EQUAL(-1, telemetry.service());
+    delay(1);
+    TEST_ASSERT_EQUAL(1, telemetry.service());
+    TEST_ASSERT_EQUAL(2, fakePlugs.requests);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 60, telemetry.sample(1).values.Power);
+}
+
+void test_unreachable_plug_uses_background_timeout() {
+    TEST_ASSERT_EQUAL(1, telemetry.service());
+    delay(500);
+    unsigned long startMs = millis();
+    TEST_ASSERT_EQUAL(0, telemetry.service());
+    TEST_ASSERT_EQUAL(TasmotaPlugs::BACKGROUND_TIMEOUT_MS, millis() - startMs);
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_HTTP_REQUEST_FAILED, telemetry.sample(0).result);
+}
+
+void test_invalid_index_is_rejected() {
+    EnergyValues values;
+    StateStatus status;
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_PLUG_REF_INVALID, tasmotaPlugs.getEnergyValues(2, 0, values));
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_PLUG_REF_INVALID, tasmotaPlugs.getRSSI(1, 1));
+    TEST_ASSERT_EQUAL(TasmotaPlugs::ERR_PLUG_REF_INVALID, tasmotaPlugs.getStateStatus(-1, 0, status));
+    TEST_ASSERT_EQUAL(0, fakePlugs.requests);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_command_uses_the_budget);
+    RUN_TEST(test_unreachable_plug_uses_background_timeout);
+    RUN_TEST(test_invalid_index_is_rejected);
+    return UNITY_END();
+}
@@ -0,0 +1,149 @@
+/*
+   Host trace runner: replays a trace captured on a gateway through the gateway sources on the PC.
+   TRACE names the capture, either the /trace.bin file downloaded from the gateway or a serial log
+   of a TraceSerial capture, whose trace| lines are decoded and concatenated. TRACE_CONFIG names
+   the gateway's config.json (default data/config.json) and TRACE_TIMED=1 reproduces the recorded
+   plug latency. The replay| line is printed as the Replay serial command prints it.
+   Run with: TRACE=capture.log pio test -e native -f test_trace_runner
+   Without TRACE only the decoding of a serial capture is checked.
+*/
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <unity.h>
+#include "i2cInterface.h"
+
+class CaptureStream : public Stream {
+public:
+    std::string text;
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+static DebugOutput logger;
+static TasmotaPlugs tasmotaPlugs;
+static TrafficTrace trafficTrace;
+static EventQueue events;
+static bool keepTraceFile;   // the capture replayed is the trace file itself
+
+static std::string readHostFile(const char* path) {
+    std::ifstream input(path, std::ios::binary);
+    std::stringstream content;
+    content << input.rdbuf();
+    return content.str();
+}
+
+static std::string readTraceFile() {
+    File file = LittleFS.open(TrafficTrace::TRACE_FILE, "r");
+    std::string content(file.size(), '\0');
+    file.read(reinterpret_cast<uint8_t*>(&content[0]), content.size());
+    return content;
+}
+
+// Writes the capture at path to the trace file, decoding it first if it is a serial log
+static bool importCapture(const char* path) {
+    std::string capture = readHostFile(path);
+    File traceFile = LittleFS.open(TrafficTrace::TRACE_FILE, "w");
+    if (capture.empty() || !traceFile) {
+        return false;
+    }
+    if (capture.find("trace|") == std::string::npos) {
+        traceFile.write(reinterpret_cast<const uint8_t*>(capture.data()), capture.size());
+        return true;
+    }
+    std::istringstream lines(capture);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::vector<uint8_t> data(line.size() / 2);
+        size_t length = TrafficTrace::decodeSerialLine(line.c_str(), data.data(), data.size());
+        traceFile.write(data.data(), length);
+    }
+    return true;
+}
+
+static std::string replayCapture(const char* path, bool timed) {
+    TEST_ASSERT_TRUE(importCapture(path));
+    tasmotaPlugs.initPlugStates();
+    I2cInterface::begin(PRIMARY_I2C_ADDR, tasmotaPlugs, logger);
+    I2cInterface::setGatewayStatus(GatewayCodes::STATUS_READY);
+    CaptureStream output;
+    I2cInterface::replay(trafficTrace, timed, output);
+    printf("%s", output.text.c_str());
+    return output.text;
+}
+
+void setUp() {
+    keepTraceFile = false;
+    tasmotaPlugs.setTrace(&trafficTrace);
+    trafficTrace.begin(logger);
+    events = EventQueue();
+    I2cInterface::setTrace(&trafficTrace);
+    I2cInterface::setEventQueue(&events);
+}
+
+void tearDown() {
+    if (!keepTraceFile) {
+        LittleFS.remove(TrafficTrace::TRACE_FILE);
+    }
+}
+
+void test_serial_capture_round_trip() {
+    static const char RSSI_REPLY[] = "{\"StatusSTS\":{\"POWER\":\"ON\",\"Wifi\":{\"RSSI\":70}}}";
+    TEST_ASSERT_TRUE(trafficTrace.startCapture(TrafficTrace::SINK_FILE));
+    trafficTrace.recordI2cCommand(I2C_CMD_RSSI, 0, 0, 100);
+    trafficTrace.recordHttp(13, CMD_STATUS_11, TrafficTrace::HTTP_COMMAND, 200, 20000, RSSI_REPLY, strlen(RSSI_REPLY));
+    trafficTrace.recordI2cReply(70, 21000);
+    trafficTrace.stopCapture();
+    std::string recorded = readTraceFile();
+
+    // the bytes split over two trace| lines with log output around them, as TraceSerial prints them
+    CaptureStream log;
+    log.print("Trace capture started\n");
+    size_t half = recorded.size() / 2;
+    TrafficTrace::encodeSerialLine(reinterpret_cast<const uint8_t*>(recorded.data()), half, log);
+    log.print("Shed plug 1 (80 W), total was 140 W, reaction 12 ms\r\n");
+    TrafficTrace::encodeSerialLine(reinterpret_cast<const uint8_t*>(recorded.data()) + half, recorded.size() - half, log);
+    const char* capturePath = LITTLEFS_HOST_DIR "/trace_capture.log";
+    std::ofstream(capturePath) << log.text;
+
+    tasmotaPlugs.config.plug_ip = {13};
+    tasmotaPlugs.config.plugs_per_ip = {1};
+    tasmotaPlugs.config.esp_pin_map = {6};
+    std::string output = replayCapture(capturePath, false);
+    remove(capturePath);
+    TEST_ASSERT_TRUE(readTraceFile() == recorded);
+    TEST_ASSERT_TRUE(output.find("replay|commands=1,") != std::string::npos);
+    TEST_ASSERT_TRUE(output.find("codeMismatches=0,requestMismatches=0") != std::string::npos);
+}
+
+void test_replay_captured_trace() {
+    const char* capturePath = getenv("TRACE");
+    char capture[PATH_MAX];
+    char traceFile[PATH_MAX];
+    keepTraceFile = realpath(capturePath, capture) != nullptr &&
+                    realpath((std::string(LITTLEFS_HOST_DIR) + TrafficTrace::TRACE_FILE).c_str(), traceFile) != nullptr && strcmp(capture, traceFile) == 0;
+    const char* configPath = getenv("TRACE_CONFIG") != nullptr ? getenv("TRACE_CONFIG") : "data/config.json";
+    File configFile(fopen(configPath, "r"));
+    TEST_ASSERT_TRUE_MESSAGE(configFile && tasmotaPlugs.config.parseConfig(configFile), configPath);
+    const char* timed = getenv("TRACE_TIMED");
+    std::string output = replayCapture(capturePath, timed != nullptr && strcmp(timed, "1") == 0);
+    TEST_ASSERT_TRUE(output.find("replay|commands=") != std::string::npos);
+}
+
+int main(int argc, char** argv) {
+    UNITY_BEGIN();
+    // the round trip writes the trace file, which may be the capture to replay
+    if (getenv("TRACE") != nullptr) {
+        RUN_TEST(test_replay_captured_trace);
+    } else {
+        RUN_TEST(test_serial_capture_round_trip);
+    }
+    return UNITY_END();
+}